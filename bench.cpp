@@ -0,0 +1,408 @@
+// Standalone benchmark for the clinic data layer. Links clinic_data only
+// (QtCore and QtSql); no window is created.
+//
+//   bench [--scales 10000,100000,1000000] [--samples 200] [--seed 42]
+//         [--patients N --appointments N --treatments N] [--out results.json]
+//   bench --profiles [--patients N] [--samples 200] [--out results.json]
+//
+// For every scale a fresh database is filled by the deterministic generator
+// and each data function is timed. With --profiles, every SQLite connection
+// profile is compared on single-row inserts and date lookups instead.
+// Results are written as JSON.
+#include "clinic_data.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSysInfo>
+
+// --- Synthetic data ---
+struct GeneratorCounts {
+    int patients;
+    int appointments;
+    int treatments;
+};
+
+class ClinicGenerator {
+public:
+    explicit ClinicGenerator(quint64 seed) : rng(seed) {}
+
+    Patient patient() {
+        // Draws happen in separate statements so the sequence does not depend
+        // on the compiler's operand evaluation order.
+        Patient p;
+        p.id = 0;
+        std::string first = pick(firstNames);
+        p.name = first + " " + pick(lastNames);
+        p.age = 1 + static_cast<int>(rng() % 95);
+        p.contact = "+1 555 " + std::to_string(1000000 + rng() % 9000000);
+        std::string condition = pick(conditions);
+        std::string other = pick(conditions);
+        p.medicalHistory = condition + ", " + other + "; " + pick(notes);
+        return p;
+    }
+
+    Appointment appointment(int patients) {
+        static const QDate start(2024, 1, 1);
+        int slot = static_cast<int>(rng() % 40);
+        QTime time(8 + slot / 4, (slot % 4) * 15);
+        int patientId = 1 + static_cast<int>(rng() % patients);
+        QDate date = start.addDays(static_cast<int>(rng() % 730));
+        std::string purpose = pick(purposes);
+        bool completed = rng() % 4 != 0;
+        int duration = 15 * (1 + slot / 10);
+        return Appointment{
+            0,
+            patientId,
+            date.toString("yyyy-MM-dd").toStdString(),
+            time.toString("HH:mm").toStdString(),
+            purpose,
+            completed,
+            duration
+        };
+    }
+
+    Treatment treatment(int patients, int appointments) {
+        Treatment t;
+        t.id = 0;
+        t.patientId = 1 + static_cast<int>(rng() % patients);
+        t.appointmentId = 1 + static_cast<int>(rng() % appointments);
+        std::string note = pick(notes);
+        std::string condition = pick(conditions);
+        t.notes = note + ", " + condition + ". " + pick(notes) + ".";
+        int meds = 1 + static_cast<int>(rng() % 4);
+        for (int i = 0; i < meds; ++i) {
+            std::string drug = pick(drugs);
+            t.medications.push_back(drug + " " + pick(doses));
+        }
+        return t;
+    }
+
+    // Fills db with the given counts through the repositories' batch inserts.
+    void fill(QSqlDatabase &db, const GeneratorCounts &counts) {
+        const int chunk = 50000;
+        Repositories &repos = repositoriesFor(db);
+        for (int done = 0; done < counts.patients; done += chunk) {
+            std::vector<Patient> batch;
+            for (int i = done; i < std::min(counts.patients, done + chunk); ++i) batch.push_back(patient());
+            repos.patients.insertBatch(batch);
+        }
+        for (int done = 0; done < counts.appointments; done += chunk) {
+            std::vector<Appointment> batch;
+            for (int i = done; i < std::min(counts.appointments, done + chunk); ++i)
+                batch.push_back(appointment(counts.patients));
+            repos.appointments.insertBatch(batch);
+        }
+        for (int done = 0; done < counts.treatments; done += chunk) {
+            std::vector<Treatment> batch;
+            for (int i = done; i < std::min(counts.treatments, done + chunk); ++i)
+                batch.push_back(treatment(counts.patients, counts.appointments));
+            repos.treatments.insertBatch(batch);
+        }
+    }
+
+    quint64 next() { return rng(); }
+
+private:
+    template <size_t N>
+    const char *pick(const char *const (&list)[N]) { return list[rng() % N]; }
+
+    static constexpr const char *firstNames[] = {
+        "Ana", "Ben", "Chloe", "Daniel", "Elena", "Farid", "Grace", "Hiro", "Ines", "Jonas",
+        "Kira", "Liam", "Maya", "Noah", "Olga", "Pedro", "Quinn", "Rosa", "Sami", "Tomas"
+    };
+    static constexpr const char *lastNames[] = {
+        "Almeida", "Brown", "Chen", "Dubois", "Eriksen", "Fischer", "Garcia", "Haddad", "Ito",
+        "Jensen", "Kowalski", "Lopez", "Moreau", "Nakamura", "Okafor", "Petrov", "Rossi", "Silva"
+    };
+    static constexpr const char *conditions[] = {
+        "asthma", "hypertension", "type 2 diabetes", "migraine", "eczema", "arthritis",
+        "anxiety", "insomnia", "gastritis", "sinusitis", "anemia", "hypothyroidism"
+    };
+    static constexpr const char *notes[] = {
+        "patient reports improvement", "follow up in two weeks", "blood pressure elevated",
+        "no known allergies", "mild fever and cough", "dose adjusted after labs",
+        "referred to specialist", "advised rest and fluids", "symptoms stable"
+    };
+    static constexpr const char *purposes[] = {
+        "Check-up", "Follow-up", "Vaccination", "Blood test", "Consultation", "Prescription renewal"
+    };
+    static constexpr const char *drugs[] = {
+        "amoxicillin", "ibuprofen", "paracetamol", "metformin", "lisinopril", "salbutamol",
+        "omeprazole", "cetirizine", "insulin glargine", "levothyroxine", "atorvastatin", "sertraline"
+    };
+    static constexpr const char *doses[] = {
+        "5 mg", "10 mg", "20 mg", "250 mg", "500 mg", "1 g", "2 puffs"
+    };
+
+    std::mt19937_64 rng;
+};
+
+// --- Measurement ---
+struct BenchResult {
+    QString operation;
+    int samples;
+    double p50Us;
+    double p99Us;
+    double meanUs;
+    double opsPerSec;
+};
+
+template <typename Op>
+BenchResult measure(const QString &operation, int samples, Op op) {
+    std::vector<qint64> nanos;
+    nanos.reserve(samples);
+    QElapsedTimer timer;
+    qint64 total = 0;
+    for (int i = 0; i < samples; ++i) {
+        timer.start();
+        op(i);
+        qint64 elapsed = timer.nsecsElapsed();
+        nanos.push_back(elapsed);
+        total += elapsed;
+    }
+    std::sort(nanos.begin(), nanos.end());
+    auto percentile = [&](int p) { return nanos[std::min<size_t>(nanos.size() - 1, nanos.size() * p / 100)] / 1000.0; };
+    return BenchResult{
+        operation,
+        samples,
+        percentile(50),
+        percentile(99),
+        total / 1000.0 / samples,
+        total > 0 ? samples * 1e9 / total : 0.0
+    };
+}
+
+QJsonObject toJson(const BenchResult &r) {
+    QJsonObject obj;
+    obj.insert("operation", r.operation);
+    obj.insert("samples", r.samples);
+    obj.insert("p50_us", r.p50Us);
+    obj.insert("p99_us", r.p99Us);
+    obj.insert("mean_us", r.meanUs);
+    obj.insert("ops_per_sec", r.opsPerSec);
+    return obj;
+}
+
+QJsonObject runScale(const GeneratorCounts &counts, int samples, quint64 seed, const QString &dir) {
+    QTextStream err(stderr);
+    const QString connection = QString("clinic_bench_%1").arg(counts.patients);
+    QJsonObject scale;
+    scale.insert("patients", counts.patients);
+    scale.insert("appointments", counts.appointments);
+    scale.insert("treatments", counts.treatments);
+
+    {
+        QString path = QDir(dir).filePath(QString("bench_%1.db").arg(counts.patients));
+        QFile::remove(path);
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(path);
+        if (!db.open()) {
+            err << "cannot open " << path << "\n";
+            return scale;
+        }
+        applySqliteProfile(db, defaultSqliteProfile());
+        createTables(db);
+        migrateSchema(db);
+
+        ClinicGenerator gen(seed);
+        QElapsedTimer timer;
+        timer.start();
+        gen.fill(db, counts);
+        qint64 rows = qint64(counts.patients) + counts.appointments + counts.treatments;
+        scale.insert("generate_rows_per_sec", rows * 1000.0 / std::max<qint64>(1, timer.elapsed()));
+        err << QString("generated %1 rows in %2 s\n").arg(rows).arg(timer.elapsed() / 1000.0, 0, 'f', 1);
+        err.flush();
+
+        // Full scans get fewer samples so the largest scale finishes in minutes.
+        int scanSamples = std::max(3, std::min(samples, 2000000 / std::max(1, counts.patients)));
+        std::vector<int> patientIds, dates;
+        for (int i = 0; i < samples; ++i) {
+            patientIds.push_back(1 + static_cast<int>(gen.next() % counts.patients));
+            dates.push_back(static_cast<int>(gen.next() % 730));
+        }
+
+        QJsonArray results;
+        results.append(toJson(measure("addPatient", samples, [&](int) {
+            addPatient(db, gen.patient());
+        })));
+        results.append(toJson(measure("addAppointment", samples, [&](int) {
+            addAppointment(db, gen.appointment(counts.patients));
+        })));
+        results.append(toJson(measure("addTreatment", samples, [&](int) {
+            addTreatment(db, gen.treatment(counts.patients, counts.appointments));
+        })));
+        results.append(toJson(measure("getAllPatients", scanSamples, [&](int) {
+            getAllPatients(db);
+        })));
+        results.append(toJson(measure("getTreatmentsByPatient", samples, [&](int i) {
+            getTreatmentsByPatient(db, patientIds[i]);
+        })));
+        results.append(toJson(measure("getTreatmentHistory", samples, [&](int i) {
+            getTreatmentHistory(db, patientIds[i]);
+        })));
+        results.append(toJson(measure("getAppointmentsByDate", samples, [&](int i) {
+            getAppointmentsByDate(db, QDate(2024, 1, 1).addDays(dates[i]).toString("yyyy-MM-dd"));
+        })));
+
+        // Type-ahead: build the prefix index from the table, then time one
+        // lookup per keystroke of generated names and phone numbers.
+        timer.restart();
+        PatientPrefixIndex lookup = PatientPrefixIndex::fromDatabase(db);
+        scale.insert("lookup_build_ms", timer.elapsed());
+        scale.insert("lookup_memory_bytes", QString::number(lookup.memoryBytes()));
+        scale.insert("lookup_keys", QString::number(lookup.keyCount()));
+        std::vector<QString> keystrokes;
+        for (int i = 0; i < samples; ++i) {
+            Patient p = gen.patient();
+            QString text = QString::fromStdString(i % 3 == 0 ? p.contact.substr(7) : p.name);
+            keystrokes.push_back(text.left(1 + static_cast<int>(gen.next() % 6)));
+        }
+        results.append(toJson(measure("prefixLookup", samples, [&](int i) {
+            lookup.lookup(keystrokes[i]);
+        })));
+
+        // A multi-practitioner clinic open 08:00-18:00.
+        const ScheduleRules rules{8 * 60, 18 * 60, 8, 15};
+        results.append(toJson(measure("checkAppointmentSlot", samples, [&](int i) {
+            Appointment a = gen.appointment(counts.patients);
+            a.date = QDate(2024, 1, 1).addDays(dates[i]).toString("yyyy-MM-dd").toStdString();
+            checkAppointmentSlot(db, a, rules);
+        })));
+        results.append(toJson(measure("findFreeSlots4Weeks", samples, [&](int i) {
+            QDate from = QDate(2024, 1, 1).addDays(dates[i]);
+            findFreeSlots(db, from, from.addDays(27), 60, 10, rules, patientIds[i]);
+        })));
+
+        // Reports: the columnar snapshot load, then the aggregates over a
+        // four-week window on all cores and on one.
+        timer.restart();
+        ReportSnapshot snapshot;
+        snapshot.load(db);
+        scale.insert("report_snapshot_load_ms", timer.elapsed());
+        scale.insert("report_snapshot_memory_bytes", QString::number(snapshot.memoryBytes()));
+        results.append(toJson(measure("computeReport4Weeks", samples, [&](int i) {
+            QDate from = QDate(2024, 1, 1).addDays(dates[i]);
+            computeReport(snapshot, from, from.addDays(27));
+        })));
+        results.append(toJson(measure("computeReport4WeeksOneThread", samples, [&](int i) {
+            QDate from = QDate(2024, 1, 1).addDays(dates[i]);
+            computeReport(snapshot, from, from.addDays(27), 1);
+        })));
+        scale.insert("results", results);
+
+        releaseRepositories(db);
+        db.close();
+        QFile::remove(path);
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return scale;
+}
+
+// Runs the insert and date-lookup workloads against one connection profile.
+QJsonObject runProfile(const QString &name, const SqliteProfile &profile, const GeneratorCounts &counts,
+                       int samples, quint64 seed, const QString &dir) {
+    const QString connection = "clinic_bench_profile";
+    QJsonObject run;
+    run.insert("profile", name);
+    run.insert("journal_mode", profile.journalMode);
+    run.insert("synchronous", profile.synchronous);
+    run.insert("cache_size_kib", profile.cacheSizeKiB);
+    run.insert("mmap_size_bytes", QString::number(profile.mmapSizeBytes));
+    run.insert("temp_store", profile.tempStore);
+
+    {
+        QString path = QDir(dir).filePath("bench_profile.db");
+        QFile::remove(path);
+        QFile::remove(path + "-wal");
+        QFile::remove(path + "-shm");
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(path);
+        if (!db.open()) return run;
+        applySqliteProfile(db, profile);
+        createTables(db);
+        migrateSchema(db);
+
+        ClinicGenerator gen(seed);
+        gen.fill(db, counts);
+        std::vector<int> dates;
+        for (int i = 0; i < samples; ++i) dates.push_back(static_cast<int>(gen.next() % 730));
+
+        // Each insert is its own transaction, so this measures commit cost.
+        QJsonArray results;
+        results.append(toJson(measure("addAppointment", samples, [&](int) {
+            addAppointment(db, gen.appointment(counts.patients));
+        })));
+        results.append(toJson(measure("getAppointmentsByDate", samples, [&](int i) {
+            getAppointmentsByDate(db, QDate(2024, 1, 1).addDays(dates[i]).toString("yyyy-MM-dd"));
+        })));
+        run.insert("results", results);
+
+        releaseRepositories(db);
+        db.close();
+        QFile::remove(path);
+        QFile::remove(path + "-wal");
+        QFile::remove(path + "-shm");
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return run;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = app.arguments();
+    auto option = [&](const QString &name, const QString &fallback) {
+        int i = args.indexOf(name);
+        return i >= 0 && i + 1 < args.size() ? args[i + 1] : fallback;
+    };
+
+    int samples = std::max(1, option("--samples", "200").toInt());
+    quint64 seed = option("--seed", "42").toULongLong();
+    QString outPath = option("--out", QString());
+
+    std::vector<GeneratorCounts> scales;
+    if (args.contains("--patients")) {
+        int patients = std::max(1, option("--patients", "10000").toInt());
+        scales.push_back(GeneratorCounts{
+            patients,
+            std::max(1, option("--appointments", QString::number(patients)).toInt()),
+            std::max(1, option("--treatments", QString::number(patients)).toInt())
+        });
+    } else {
+        for (const QString &n : option("--scales", "10000,100000,1000000").split(',', Qt::SkipEmptyParts)) {
+            int rows = std::max(1, n.toInt());
+            scales.push_back(GeneratorCounts{rows, rows, rows});
+        }
+    }
+
+    QTemporaryDir dir;
+    const bool compareProfiles = args.contains("--profiles");
+    QJsonArray runs;
+    if (compareProfiles) {
+        GeneratorCounts counts = scales.size() == 1 && args.contains("--patients")
+            ? scales.front() : GeneratorCounts{100000, 100000, 100000};
+        for (const auto &named : sqliteProfilePresets())
+            runs.append(runProfile(named.first, named.second, counts, samples, seed, dir.path()));
+    } else {
+        for (const GeneratorCounts &counts : scales)
+            runs.append(runScale(counts, samples, seed, dir.path()));
+    }
+
+    QJsonObject report;
+    report.insert("benchmark", compareProfiles ? "clinic-profiles" : "clinic-data");
+    report.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    report.insert("host", QSysInfo::machineHostName());
+    report.insert("seed", QString::number(seed));
+    report.insert("samples", samples);
+    report.insert("schema_version", kSchemaVersion);
+    report.insert(compareProfiles ? "profiles" : "scales", runs);
+
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (outPath.isEmpty()) {
+        QTextStream(stdout) << json;
+    } else {
+        QFile out(outPath);
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) return 1;
+        out.write(json);
+    }
+    Logger::instance().shutdown();
+    return 0;
+}
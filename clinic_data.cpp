@@ -0,0 +1,1581 @@
+#include "clinic_data.h"
+
+#ifdef CLINIC_SYSTEM_SQLITE
+#include <QtSql/QSqlDriver>
+#include <sqlite3.h>
+#endif
+
+// --- Logging ---
+
+void writeLog(const QString &message, LogLevel level) {
+    Logger::instance().log(level, message);
+}
+
+// --- Query metrics ---
+
+QString redactedBindings(const QSqlQuery &query) {
+    QStringList values;
+    const int count = query.boundValues().size();
+    for (int i = 0; i < count; ++i) {
+        QVariant v = query.boundValue(i);
+        switch (v.isNull() ? QMetaType::UnknownType : v.userType()) {
+        case QMetaType::UnknownType: values << "NULL"; break;
+        case QMetaType::Bool:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+        case QMetaType::Double: values << v.toString(); break;
+        default: values << QString("<text:%1>").arg(v.toString().size()); break;
+        }
+    }
+    return values.join(", ");
+}
+
+bool execTimed(QSqlQuery &query, const QString &key) {
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = query.exec();
+    qint64 us = timer.nsecsElapsed() / 1000;
+    QueryMetrics &metrics = QueryMetrics::instance();
+    metrics.record(key, us, ok);
+    if (us >= metrics.slowThreshold() * 1000) {
+        writeLog(QString("Slow query %1: %2 ms, %3 [%4]")
+                 .arg(key).arg(us / 1000.0, 0, 'f', 1)
+                 .arg(query.lastQuery().simplified(), redactedBindings(query)), LogLevel::Warning);
+    }
+    return ok;
+}
+
+// --- Connection setup ---
+
+std::vector<std::pair<QString, SqliteProfile>> sqliteProfilePresets() {
+    return {
+        {"Balanced (WAL)", SqliteProfile{"WAL", "NORMAL", 16384, 256LL * 1024 * 1024, "MEMORY", 5000}},
+        {"Durable (WAL, full sync)", SqliteProfile{"WAL", "FULL", 16384, 256LL * 1024 * 1024, "MEMORY", 5000}},
+        {"Qt default", SqliteProfile{"DELETE", "FULL", 2000, 0, "DEFAULT", 5000}}
+    };
+}
+
+SqliteProfile defaultSqliteProfile() {
+    return sqliteProfilePresets().front().second;
+}
+
+SqliteProfile loadSqliteProfile() {
+    SqliteProfile d = defaultSqliteProfile();
+    QSettings settings(kSettingsOrganization, kSettingsApplication);
+    settings.beginGroup("sqlite");
+    SqliteProfile p{
+        settings.value("journalMode", d.journalMode).toString(),
+        settings.value("synchronous", d.synchronous).toString(),
+        settings.value("cacheSizeKiB", d.cacheSizeKiB).toInt(),
+        settings.value("mmapSizeBytes", d.mmapSizeBytes).toLongLong(),
+        settings.value("tempStore", d.tempStore).toString(),
+        settings.value("busyTimeoutMs", d.busyTimeoutMs).toInt()
+    };
+    settings.endGroup();
+    return p;
+}
+
+void saveSqliteProfile(const SqliteProfile &p) {
+    QSettings settings(kSettingsOrganization, kSettingsApplication);
+    settings.beginGroup("sqlite");
+    settings.setValue("journalMode", p.journalMode);
+    settings.setValue("synchronous", p.synchronous);
+    settings.setValue("cacheSizeKiB", p.cacheSizeKiB);
+    settings.setValue("mmapSizeBytes", p.mmapSizeBytes);
+    settings.setValue("tempStore", p.tempStore);
+    settings.setValue("busyTimeoutMs", p.busyTimeoutMs);
+    settings.endGroup();
+}
+
+bool applySqliteProfile(QSqlDatabase &db, const SqliteProfile &p, QString *error) {
+    static const QStringList journalModes{"WAL", "DELETE", "TRUNCATE"};
+    static const QStringList syncModes{"OFF", "NORMAL", "FULL"};
+    static const QStringList tempStores{"DEFAULT", "FILE", "MEMORY"};
+
+    // Values are interpolated into PRAGMA text, so only known keywords pass.
+    const QStringList pragmas{
+        "PRAGMA journal_mode = " + (journalModes.contains(p.journalMode) ? p.journalMode : QString("WAL")),
+        "PRAGMA synchronous = " + (syncModes.contains(p.synchronous) ? p.synchronous : QString("NORMAL")),
+        QString("PRAGMA cache_size = -%1").arg(std::max(0, p.cacheSizeKiB)),
+        QString("PRAGMA mmap_size = %1").arg(std::max<qint64>(0, p.mmapSizeBytes)),
+        "PRAGMA temp_store = " + (tempStores.contains(p.tempStore) ? p.tempStore : QString("DEFAULT")),
+        QString("PRAGMA busy_timeout = %1").arg(std::max(0, p.busyTimeoutMs))
+    };
+
+    QSqlQuery query(db);
+    bool ok = true;
+    auto fail = [&](const QString &message) {
+        writeLog(message, LogLevel::Warning);
+        if (error) *error += (error->isEmpty() ? QString() : QString("\n")) + message;
+        ok = false;
+    };
+    for (const QString &pragma : pragmas) {
+        if (!query.exec(pragma)) {
+            fail("Failed to apply " + pragma + ": " + query.lastError().text());
+        } else if (pragma.startsWith("PRAGMA journal_mode") && query.next()) {
+            // journal_mode reports the mode in effect, which is the old one if the switch was refused.
+            QString mode = query.value(0).toString();
+            if (mode.compare(pragma.section(' ', -1), Qt::CaseInsensitive) != 0)
+                fail(QString("%1 was not applied; the journal mode is still %2").arg(pragma, mode));
+        }
+        query.finish();
+    }
+    return ok;
+}
+
+bool openConfiguredConnection(QSqlDatabase &db) {
+    if (!db.open()) return false;
+    applySqliteProfile(db, loadSqliteProfile());
+    return true;
+}
+
+void createTables(QSqlDatabase &db) {
+    QSqlQuery query(db);
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS Patients ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                    "name TEXT,"
+                    "age INTEGER,"
+                    "contact TEXT,"
+                    "medicalHistory TEXT)")) {
+        writeLog("Failed to create Patients table:" + query.lastError().text(), LogLevel::Error);
+    } else writeLog("Patients table created or already exists" + query.lastError().text());
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS Appointments ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                    "patientId INTEGER,"
+                    "date TEXT,"
+                    "time TEXT,"
+                    "purpose TEXT,"
+                    "completed INTEGER)")) {
+        writeLog("Failed to create Appointments table:" + query.lastError().text(), LogLevel::Error);
+    } else writeLog("Appointments table created or already exists");
+
+    if (!query.exec("CREATE TABLE IF NOT EXISTS Treatments ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                    "patientId INTEGER,"
+                    "appointmentId INTEGER,"
+                    "notes TEXT,"
+                    "medications TEXT)")) {
+        writeLog("Failed to create Treatments table:" + query.lastError().text(), LogLevel::Error);
+    } else writeLog("Treatments table created or already exists");
+
+    // Full-text indexes over medical history, treatment notes and medications.
+    // Both are external-content FTS5 tables kept in sync by triggers; existing
+    // rows are backfilled by schema migration 2.
+    static const char *searchDdl[] = {
+        "CREATE VIRTUAL TABLE IF NOT EXISTS PatientsFts USING fts5("
+        "name, medicalHistory, content='Patients', content_rowid='id', "
+        "tokenize='unicode61 remove_diacritics 2')",
+        "CREATE TRIGGER IF NOT EXISTS patients_fts_insert AFTER INSERT ON Patients BEGIN "
+        "INSERT INTO PatientsFts(rowid, name, medicalHistory) VALUES (new.id, new.name, new.medicalHistory); END",
+        "CREATE TRIGGER IF NOT EXISTS patients_fts_delete AFTER DELETE ON Patients BEGIN "
+        "INSERT INTO PatientsFts(PatientsFts, rowid, name, medicalHistory) "
+        "VALUES ('delete', old.id, old.name, old.medicalHistory); END",
+        "CREATE TRIGGER IF NOT EXISTS patients_fts_update AFTER UPDATE ON Patients BEGIN "
+        "INSERT INTO PatientsFts(PatientsFts, rowid, name, medicalHistory) "
+        "VALUES ('delete', old.id, old.name, old.medicalHistory); "
+        "INSERT INTO PatientsFts(rowid, name, medicalHistory) VALUES (new.id, new.name, new.medicalHistory); END",
+
+        "CREATE VIRTUAL TABLE IF NOT EXISTS TreatmentsFts USING fts5("
+        "notes, medications, content='Treatments', content_rowid='id', "
+        "tokenize='unicode61 remove_diacritics 2')",
+        "CREATE TRIGGER IF NOT EXISTS treatments_fts_insert AFTER INSERT ON Treatments BEGIN "
+        "INSERT INTO TreatmentsFts(rowid, notes, medications) VALUES (new.id, new.notes, new.medications); END",
+        "CREATE TRIGGER IF NOT EXISTS treatments_fts_delete AFTER DELETE ON Treatments BEGIN "
+        "INSERT INTO TreatmentsFts(TreatmentsFts, rowid, notes, medications) "
+        "VALUES ('delete', old.id, old.notes, old.medications); END",
+        "CREATE TRIGGER IF NOT EXISTS treatments_fts_update AFTER UPDATE ON Treatments BEGIN "
+        "INSERT INTO TreatmentsFts(TreatmentsFts, rowid, notes, medications) "
+        "VALUES ('delete', old.id, old.notes, old.medications); "
+        "INSERT INTO TreatmentsFts(rowid, notes, medications) VALUES (new.id, new.notes, new.medications); END"
+    };
+    for (const char *sql : searchDdl) {
+        if (!query.exec(sql)) {
+            writeLog("Failed to create search index:" + query.lastError().text(), LogLevel::Error);
+            break;
+        }
+    }
+}
+
+// --- Schema migrations ---
+
+int schemaVersion(QSqlDatabase &db) {
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA user_version") || !query.next()) return 0;
+    return query.value(0).toInt();
+}
+
+bool migrateSchema(QSqlDatabase &db) {
+    static const std::vector<std::vector<const char*>> steps = {
+        // 1: indexes for the calendar date lookup, the patient JOIN and treatment history
+        {
+            "CREATE INDEX IF NOT EXISTS idx_appointments_date_time ON Appointments(date, time)",
+            "CREATE INDEX IF NOT EXISTS idx_appointments_patient ON Appointments(patientId)",
+            "CREATE INDEX IF NOT EXISTS idx_treatments_patient_appt ON Treatments(patientId, appointmentId)"
+        },
+        // 2: backfill the full-text indexes from rows written before they existed
+        {
+            "INSERT INTO PatientsFts(PatientsFts) VALUES ('rebuild')",
+            "INSERT INTO TreatmentsFts(TreatmentsFts) VALUES ('rebuild')"
+        },
+        // 3: one row per prescribed medication, backfilled by splitting the
+        // existing ';'-joined column, which is then stored without a trailing ';'
+        {
+            "CREATE TABLE IF NOT EXISTS TreatmentMedications ("
+            "treatmentId INTEGER NOT NULL,"
+            "name TEXT NOT NULL COLLATE NOCASE)",
+            "CREATE INDEX IF NOT EXISTS idx_treatment_medications_name ON TreatmentMedications(name)",
+            "CREATE INDEX IF NOT EXISTS idx_treatment_medications_treatment ON TreatmentMedications(treatmentId)",
+            "CREATE TRIGGER IF NOT EXISTS treatment_medications_delete AFTER DELETE ON Treatments BEGIN "
+            "DELETE FROM TreatmentMedications WHERE treatmentId = old.id; END",
+            "WITH RECURSIVE split(treatmentId, item, rest) AS ("
+            " SELECT id, '', medications || ';' FROM Treatments WHERE medications IS NOT NULL"
+            " UNION ALL"
+            " SELECT treatmentId, trim(substr(rest, 1, instr(rest, ';') - 1)), substr(rest, instr(rest, ';') + 1)"
+            " FROM split WHERE rest <> '')"
+            " INSERT INTO TreatmentMedications (treatmentId, name)"
+            " SELECT treatmentId, item FROM split WHERE item <> ''",
+            "UPDATE Treatments SET medications = rtrim(medications, '; ') WHERE medications LIKE '%;'"
+        },
+        // 4: appointment length for conflict checks and free-slot search
+        {
+            "ALTER TABLE Appointments ADD COLUMN duration INTEGER NOT NULL DEFAULT 30"
+        },
+        // 5: import checkpoints, written in the same transaction as each chunk
+        {
+            "CREATE TABLE IF NOT EXISTS ImportState ("
+            "path TEXT PRIMARY KEY,"
+            "tableName TEXT NOT NULL,"
+            "fileSize INTEGER NOT NULL,"
+            "fileModified INTEGER NOT NULL,"
+            "headHash TEXT NOT NULL,"
+            "byteOffset INTEGER NOT NULL,"
+            "rowsImported INTEGER NOT NULL,"
+            "rowsRejected INTEGER NOT NULL,"
+            "recordNumber INTEGER NOT NULL,"
+            "rejectsSize INTEGER NOT NULL)"
+        }
+    };
+
+    int version = schemaVersion(db);
+    while (version < kSchemaVersion) {
+        const auto &step = steps[version];
+        QSqlQuery query(db);
+        if (!db.transaction()) {
+            writeLog(QString("Migration to schema version %1 could not begin: ").arg(version + 1) + db.lastError().text(), LogLevel::Error);
+            return false;
+        }
+
+        bool ok = true;
+        for (const char *sql : step) {
+            if (!query.exec(sql)) {
+                writeLog(QString("Migration to schema version %1 failed: ").arg(version + 1) + query.lastError().text(), LogLevel::Error);
+                ok = false;
+                break;
+            }
+        }
+        if (ok && !query.exec(QString("PRAGMA user_version = %1").arg(version + 1))) {
+            writeLog("Failed to set user_version: " + query.lastError().text(), LogLevel::Error);
+            ok = false;
+        }
+        if (ok && !db.commit()) {
+            writeLog(QString("Migration to schema version %1 could not commit: ").arg(version + 1) + db.lastError().text(), LogLevel::Error);
+            ok = false;
+        }
+        if (!ok) {
+            db.rollback();
+            return false;
+        }
+        ++version;
+        writeLog(QString("Database upgraded to schema version %1").arg(version));
+    }
+    return true;
+}
+
+void explainHotQueries(QSqlDatabase &db) {
+    const std::vector<std::pair<const char*, const char*>> hotQueries = {
+        {"calendar date lookup",
+         "SELECT a.time, a.patientId, p.name, a.purpose FROM Appointments a "
+         "JOIN Patients p ON a.patientId = p.id WHERE a.date = '2000-01-01'"},
+        {"appointments by patient",
+         "SELECT id, date, time FROM Appointments WHERE patientId = 1"},
+        {"treatments by patient",
+         "SELECT id, patientId, appointmentId, notes, medications FROM Treatments WHERE patientId = 1"},
+        {"treatment by patient and appointment",
+         "SELECT id FROM Treatments WHERE patientId = 1 AND appointmentId = 1"},
+        {"patients on medication",
+         "SELECT DISTINCT p.id, p.name FROM TreatmentMedications m "
+         "JOIN Treatments t ON t.id = m.treatmentId JOIN Patients p ON p.id = t.patientId "
+         "WHERE m.name = 'ibuprofen' ORDER BY p.id"},
+        {"top medications",
+         "SELECT name, COUNT(*) AS prescriptions FROM TreatmentMedications "
+         "GROUP BY name ORDER BY prescriptions DESC, name LIMIT 10"}
+    };
+
+    QTextStream out(stdout);
+    for (const auto &hq : hotQueries) {
+        out << "-- " << hq.first << "\n";
+        QSqlQuery query(db);
+        query.prepare(QString("EXPLAIN QUERY PLAN ") + hq.second);
+        if (!execTimed(query, "explain")) {
+            out << "   error: " << query.lastError().text() << "\n";
+            continue;
+        }
+        while (query.next())
+            out << "   " << query.value(3).toString() << "\n";
+    }
+    out.flush();
+}
+
+// --- Medications ---
+
+std::vector<std::string> splitMedications(const std::string &text) {
+    std::vector<std::string> meds;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(';', start);
+        if (end == std::string::npos) end = text.size();
+
+        size_t first = start, last = end;
+        while (first < last && std::isspace(static_cast<unsigned char>(text[first]))) ++first;
+        while (last > first && std::isspace(static_cast<unsigned char>(text[last - 1]))) --last;
+        if (last > first) meds.emplace_back(text, first, last - first);
+
+        start = end + 1;
+    }
+    return meds;
+}
+
+QStringList splitMedications(QStringView text) {
+    QStringList meds;
+    qsizetype start = 0;
+    while (start <= text.size()) {
+        qsizetype end = text.indexOf(QLatin1Char(';'), start);
+        if (end < 0) end = text.size();
+        QStringView entry = text.mid(start, end - start).trimmed();
+        if (!entry.isEmpty()) meds << entry.toString();
+        start = end + 1;
+    }
+    return meds;
+}
+
+QString joinMedications(const std::vector<std::string> &meds) {
+    std::string joined;
+    size_t length = 0;
+    for (const auto &m : meds) length += m.size() + 1;
+    joined.reserve(length);
+    for (const auto &m : meds) {
+        if (!joined.empty()) joined += ';';
+        joined += m;
+    }
+    return QString::fromStdString(joined);
+}
+
+// --- Repositories ---
+
+StatementCacheStats &statementCacheStats() {
+    static StatementCacheStats stats;
+    return stats;
+}
+
+std::unordered_map<std::string, std::unique_ptr<Repositories>> &repositoryRegistry() {
+    thread_local std::unordered_map<std::string, std::unique_ptr<Repositories>> registry;
+    return registry;
+}
+
+Repositories &repositoriesFor(QSqlDatabase &db) {
+    auto &registry = repositoryRegistry();
+    std::string key = db.connectionName().toStdString();
+    auto it = registry.find(key);
+    if (it == registry.end())
+        it = registry.emplace(key, std::make_unique<Repositories>(db)).first;
+    return *it->second;
+}
+
+void releaseRepositories(QSqlDatabase &db) {
+    repositoryRegistry().erase(db.connectionName().toStdString());
+}
+
+bool addPatient(QSqlDatabase &db, const Patient &p, int *newId) {
+    return repositoriesFor(db).patients.insert(p, newId);
+}
+
+std::vector<Patient> getAllPatients(QSqlDatabase &db) {
+    return repositoriesFor(db).patients.all();
+}
+
+std::vector<PatientSummary> getPatientPage(QSqlDatabase &db, int afterId, int limit) {
+    return repositoriesFor(db).patients.page(afterId, limit);
+}
+
+Patient getPatientById(QSqlDatabase &db, int patientId) {
+    return repositoriesFor(db).patients.byId(patientId);
+}
+
+bool updatePatient(QSqlDatabase &db, const Patient &p) {
+    return repositoriesFor(db).patients.update(p);
+}
+
+bool deletePatient(QSqlDatabase &db, int patientId) {
+    return repositoriesFor(db).patients.remove(patientId);
+}
+
+bool addTreatment(QSqlDatabase &db, const Treatment &t) {
+    return repositoriesFor(db).treatments.insert(t);
+}
+
+std::vector<Treatment> getTreatmentsByPatient(QSqlDatabase &db, int patientId) {
+    return repositoriesFor(db).treatments.byPatient(patientId);
+}
+
+std::vector<TreatmentRow> getTreatmentHistory(QSqlDatabase &db, int patientId) {
+    return repositoriesFor(db).treatments.historyByPatient(patientId);
+}
+
+std::vector<PatientSummary> getPatientsOnMedication(QSqlDatabase &db, const QString &medication) {
+    return repositoriesFor(db).treatments.patientsOnMedication(medication);
+}
+
+std::vector<MedicationCount> getTopMedications(QSqlDatabase &db, int limit) {
+    return repositoriesFor(db).treatments.topMedications(limit);
+}
+
+bool updateTreatment(QSqlDatabase &db, const Treatment &t) {
+    return repositoriesFor(db).treatments.update(t);
+}
+
+bool deleteTreatment(QSqlDatabase &db, int patientId, int appointmentId) {
+    return repositoriesFor(db).treatments.remove(patientId, appointmentId);
+}
+
+bool addAppointment(QSqlDatabase &db, const Appointment &a) {
+    return repositoriesFor(db).appointments.insert(a);
+}
+
+bool updateAppointment(QSqlDatabase &db, const Appointment &a) {
+    return repositoriesFor(db).appointments.update(a);
+}
+
+bool deleteAppointment(QSqlDatabase &db, int appointmentId) {
+    return repositoriesFor(db).appointments.remove(appointmentId);
+}
+
+std::vector<DayAppointment> getAppointmentsByDate(QSqlDatabase &db, const QString &date) {
+    return repositoriesFor(db).appointments.byDate(date);
+}
+
+std::vector<DayAppointment> getAppointmentsInRange(QSqlDatabase &db, const QString &from, const QString &to) {
+    return repositoriesFor(db).appointments.inRange(from, to);
+}
+
+// --- Scheduling ---
+
+ScheduleRules loadScheduleRules() {
+    QSettings settings(kSettingsOrganization, kSettingsApplication);
+    settings.beginGroup("schedule");
+    auto minuteOf = [&](const char *key, const char *fallback) {
+        QTime t = QTime::fromString(settings.value(key, fallback).toString(), "HH:mm");
+        if (!t.isValid()) t = QTime::fromString(fallback, "HH:mm");
+        return t.hour() * 60 + t.minute();
+    };
+    ScheduleRules rules{
+        minuteOf("opens", "08:00"),
+        minuteOf("closes", "18:00"),
+        std::max(1, settings.value("practitioners", 1).toInt()),
+        std::max(5, settings.value("stepMinutes", 15).toInt())
+    };
+    settings.endGroup();
+    return rules;
+}
+
+SlotCheck checkSlot(const DaySchedule &day, const ScheduleRules &rules, int patientId, int start, int duration) {
+    int end = start + duration;
+    if (duration <= 0) return SlotCheck{false, "duration must be positive"};
+    if (start < rules.opensMinute || end > rules.closesMinute) {
+        return SlotCheck{false, QString("outside opening hours (%1-%2)")
+                         .arg(QTime(0, 0).addSecs(rules.opensMinute * 60).toString("HH:mm"),
+                              QTime(0, 0).addSecs(rules.closesMinute * 60).toString("HH:mm"))};
+    }
+    if (patientId > 0 && day.patientBusy(patientId, start, end))
+        return SlotCheck{false, "the patient already has an appointment at that time"};
+    if (day.peak(start, end) >= rules.practitioners)
+        return SlotCheck{false, "every practitioner is booked at that time"};
+    return SlotCheck{true, QString()};
+}
+
+SlotCheck checkAppointmentSlot(QSqlDatabase &db, const Appointment &a, const ScheduleRules &rules) {
+    QDate date = QDate::fromString(QString::fromStdString(a.date), "yyyy-MM-dd");
+    QTime time = QTime::fromString(QString::fromStdString(a.time), "HH:mm");
+    if (!date.isValid() || !time.isValid()) return SlotCheck{false, "date or time is invalid"};
+    auto days = repositoriesFor(db).appointments.bookings(date, date);
+    DaySchedule day(days[date], a.id);
+    return checkSlot(day, rules, a.patientId, time.hour() * 60 + time.minute(), a.durationMinutes);
+}
+
+bool bookAppointment(QSqlDatabase &db, const Appointment &a, QString *conflict) {
+    Repositories &repos = repositoriesFor(db);
+    QSqlQuery begin(db);
+    if (!begin.exec("BEGIN IMMEDIATE")) {
+        if (conflict) *conflict = "Failed to begin transaction: " + begin.lastError().text();
+        return false;
+    }
+    size_t mark = repos.changes.begin();
+    SlotCheck check{true, QString()};
+    if (a.id <= 0 || !repos.appointments.sameSlot(a)) check = checkAppointmentSlot(db, a, loadScheduleRules());
+    bool ok = check.free && (a.id > 0 ? repos.appointments.update(a) : repos.appointments.insert(a));
+    if (ok && db.commit()) {
+        repos.changes.commit();
+        return true;
+    }
+    db.rollback();
+    repos.changes.rollback(mark);
+    if (conflict) *conflict = check.free ? QString("The appointment could not be saved.") : check.reason;
+    return false;
+}
+
+std::vector<FreeSlot> findFreeSlots(QSqlDatabase &db, const QDate &from, const QDate &to, int duration, int count,
+                                    const ScheduleRules &rules, int patientId,
+                                    const QDateTime &notBefore) {
+    std::vector<FreeSlot> slots;
+    if (duration <= 0 || count <= 0 || to < from) return slots;
+    const std::vector<Booking> none;
+    // Read a week at a time so a nearly empty schedule does not load the whole range.
+    for (QDate weekStart = from; weekStart <= to && static_cast<int>(slots.size()) < count;
+         weekStart = weekStart.addDays(7)) {
+        QDate weekEnd = std::min(to, weekStart.addDays(6));
+        auto days = repositoriesFor(db).appointments.bookings(weekStart, weekEnd);
+        for (QDate date = weekStart; date <= weekEnd; date = date.addDays(1)) {
+            auto it = days.find(date);
+            DaySchedule day(it != days.end() ? it->second : none);
+            for (int start = rules.opensMinute; start + duration <= rules.closesMinute; start += rules.stepMinutes) {
+                QTime time = QTime(0, 0).addSecs(start * 60);
+                if (notBefore.isValid() && QDateTime(date, time) < notBefore) continue;
+                if (!checkSlot(day, rules, patientId, start, duration).free) continue;
+                slots.push_back(FreeSlot{date, time});
+                if (static_cast<int>(slots.size()) == count) return slots;
+            }
+        }
+    }
+    return slots;
+}
+
+// --- Full-text search ---
+
+void weightRanks(std::vector<SearchHit> &hits, size_t from, double weight) {
+    for (size_t i = from; i < hits.size(); ++i) hits[i].rank *= weight;
+}
+
+QString ftsQueryFromInput(const QString &input) {
+    QStringList terms;
+    const QStringList words = input.simplified().split(' ', Qt::SkipEmptyParts);
+    for (int i = 0; i < words.size(); ++i) {
+        QString word = words[i];
+        word.replace("\"", "\"\"");
+        terms << "\"" + word + "\"" + (i == words.size() - 1 ? "*" : "");
+    }
+    return terms.join(' ');
+}
+
+std::vector<SearchHit> searchClinic(QSqlDatabase &db, const QString &input, int limit) {
+    std::vector<SearchHit> hits;
+    QString match = ftsQueryFromInput(input);
+    if (match.isEmpty()) return hits;
+
+    QSqlQuery query(db);
+    query.prepare("SELECT p.id, p.name, snippet(PatientsFts, -1, '[', ']', '...', 10), bm25(PatientsFts) "
+                  "FROM PatientsFts JOIN Patients p ON p.id = PatientsFts.rowid "
+                  "WHERE PatientsFts MATCH ? ORDER BY bm25(PatientsFts) LIMIT ?");
+    query.addBindValue(match);
+    query.addBindValue(limit);
+    if (!execTimed(query, "search.patients")) {
+        writeLog("Patient search failed: " + query.lastError().text(), LogLevel::Error);
+        return hits;
+    }
+    while (query.next())
+        hits.push_back(SearchHit{query.value(0).toInt(), query.value(1).toString(),
+                                 query.value(2).toString(), query.value(3).toDouble()});
+    weightRanks(hits, 0, kPatientSearchWeight);
+    const size_t treatmentsFrom = hits.size();
+
+    query.prepare("SELECT t.patientId, p.name, snippet(TreatmentsFts, -1, '[', ']', '...', 10), bm25(TreatmentsFts) "
+                  "FROM TreatmentsFts JOIN Treatments t ON t.id = TreatmentsFts.rowid "
+                  "LEFT JOIN Patients p ON p.id = t.patientId "
+                  "WHERE TreatmentsFts MATCH ? ORDER BY bm25(TreatmentsFts) LIMIT ?");
+    query.addBindValue(match);
+    query.addBindValue(limit);
+    if (!execTimed(query, "search.treatments")) {
+        writeLog("Treatment search failed: " + query.lastError().text(), LogLevel::Error);
+        return hits;
+    }
+    while (query.next())
+        hits.push_back(SearchHit{query.value(0).toInt(), query.value(1).toString(),
+                                 query.value(2).toString(), query.value(3).toDouble()});
+    weightRanks(hits, treatmentsFrom, kTreatmentSearchWeight);
+
+    std::stable_sort(hits.begin(), hits.end(), [](const SearchHit &a, const SearchHit &b) { return a.rank < b.rank; });
+    if (static_cast<int>(hits.size()) > limit) hits.resize(limit);
+    return hits;
+}
+
+bool rebuildSearchIndex(QSqlDatabase &db) {
+    QSqlQuery query(db);
+    for (const char *table : {"PatientsFts", "TreatmentsFts"}) {
+        query.prepare(QString("INSERT INTO %1(%1) VALUES ('rebuild')").arg(table));
+        if (!execTimed(query, "search.rebuild")) {
+            writeLog("Failed to rebuild search index: " + query.lastError().text(), LogLevel::Error);
+            return false;
+        }
+    }
+    return true;
+}
+
+int runSearchBenchmark(int notes) {
+    static const char *conditions[] = {
+        "asthma", "hypertension", "diabetes", "migraine", "bronchitis", "eczema", "arthritis",
+        "anxiety", "insomnia", "gastritis", "sinusitis", "anemia", "tonsillitis", "otitis"
+    };
+    static const char *drugs[] = {
+        "amoxicillin", "ibuprofen", "paracetamol", "metformin", "lisinopril", "salbutamol",
+        "omeprazole", "cetirizine", "insulin", "prednisolone", "atorvastatin", "sertraline"
+    };
+    static const char *phrases[] = {
+        "patient reports", "follow up in two weeks", "chest pain on exertion", "no known allergies",
+        "blood pressure elevated", "mild fever", "persistent cough", "dose adjusted", "symptoms improving",
+        "referred to specialist", "lab results normal", "advised rest and fluids"
+    };
+
+    QTextStream out(stdout);
+    QTemporaryDir dir;
+    const QString connection = "clinic_search_bench";
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(dir.filePath("search_bench.db"));
+        if (!db.open()) return 1;
+        applySqliteProfile(db, defaultSqliteProfile());
+        createTables(db);
+        migrateSchema(db);
+
+        std::mt19937 rng(20240601);
+        auto pick = [&rng](const auto &list) {
+            return list[rng() % (sizeof(list) / sizeof(list[0]))];
+        };
+
+        QElapsedTimer timer;
+        timer.start();
+        const int chunk = 50000;
+        for (int done = 0; done < notes; done += chunk) {
+            std::vector<Treatment> batch;
+            for (int i = done; i < std::min(notes, done + chunk); ++i) {
+                std::string text = std::string(pick(phrases)) + ", " + pick(conditions) + "; " +
+                                   pick(phrases) + ". " + pick(phrases) + ".";
+                batch.push_back(Treatment{0, 1 + i / 20, 1 + i / 2, text, {pick(drugs), pick(drugs)}});
+            }
+            repositoriesFor(db).treatments.insertBatch(batch);
+        }
+        out << QString("generated %1 notes in %2 s\n").arg(notes).arg(timer.elapsed() / 1000.0, 0, 'f', 1);
+
+        const QStringList queries{"asthma", "amoxicillin", "chest pain", "hypert", "insulin dose", "zzz"};
+        const int runs = 50;
+        for (const QString &q : queries) {
+            std::vector<qint64> samples;
+            size_t found = 0;
+            for (int r = 0; r < runs; ++r) {
+                timer.restart();
+                found = searchClinic(db, q).size();
+                samples.push_back(timer.nsecsElapsed());
+            }
+            std::sort(samples.begin(), samples.end());
+            out << QString("%1: p50 %2 ms, p99 %3 ms, %4 hits\n")
+                   .arg(q, -14)
+                   .arg(samples[runs / 2] / 1e6, 0, 'f', 2)
+                   .arg(samples[runs * 99 / 100] / 1e6, 0, 'f', 2)
+                   .arg(found);
+        }
+        releaseRepositories(db);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connection);
+    return 0;
+}
+
+// --- Bulk import ---
+
+bool parseClinicTable(const QString &name, ClinicTable *table) {
+    QString lower = name.toLower();
+    if (lower == "patients") *table = ClinicTable::Patients;
+    else if (lower == "appointments") *table = ClinicTable::Appointments;
+    else if (lower == "treatments") *table = ClinicTable::Treatments;
+    else return false;
+    return true;
+}
+
+bool importInt(const ImportRow &row, const QString &name, int *out, QString *reason) {
+    bool ok = false;
+    int value = row.text(name).trimmed().toInt(&ok);
+    if (!ok) {
+        *reason = QString("%1 is not an integer").arg(name);
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+bool rowToPatient(const ImportRow &row, Patient *p, QString *reason) {
+    p->id = 0;
+    if (row.has("id") && !row.text("id").trimmed().isEmpty() && !importInt(row, "id", &p->id, reason)) return false;
+    QString name = row.text("name").trimmed();
+    QString contact = row.text("contact").trimmed();
+    if (name.isEmpty()) { *reason = "name is empty"; return false; }
+    if (!importInt(row, "age", &p->age, reason)) return false;
+    if (p->age < 0 || p->age > 150) { *reason = "age out of range"; return false; }
+    p->name = name.toStdString();
+    p->contact = contact.toStdString();
+    p->medicalHistory = row.text("medicalHistory").trimmed().toStdString();
+    return true;
+}
+
+bool rowToAppointment(const ImportRow &row, Appointment *a, QString *reason) {
+    a->id = 0;
+    if (row.has("id") && !row.text("id").trimmed().isEmpty() && !importInt(row, "id", &a->id, reason)) return false;
+    if (!importInt(row, "patientId", &a->patientId, reason)) return false;
+    if (a->patientId <= 0) { *reason = "patientId must be positive"; return false; }
+
+    QString date = row.text("date").trimmed();
+    QString time = row.text("time").trimmed();
+    if (!QDate::fromString(date, "yyyy-MM-dd").isValid()) { *reason = "date is not yyyy-MM-dd"; return false; }
+    if (!QTime::fromString(time, "HH:mm").isValid()) { *reason = "time is not HH:mm"; return false; }
+
+    QString completed = row.text("completed").trimmed().toLower();
+    if (!completed.isEmpty() && completed != "0" && completed != "1" && completed != "true" && completed != "false") {
+        *reason = "completed is not a boolean";
+        return false;
+    }
+    a->date = date.toStdString();
+    a->time = time.toStdString();
+    a->purpose = row.text("purpose").trimmed().toStdString();
+    a->completed = completed == "1" || completed == "true";
+    a->durationMinutes = 30;
+    if (row.has("duration") && !row.text("duration").trimmed().isEmpty()) {
+        if (!importInt(row, "duration", &a->durationMinutes, reason)) return false;
+        if (a->durationMinutes <= 0) { *reason = "duration must be positive"; return false; }
+    }
+    return true;
+}
+
+bool rowToTreatment(const ImportRow &row, Treatment *t, QString *reason) {
+    t->id = 0;
+    if (row.has("id") && !row.text("id").trimmed().isEmpty() && !importInt(row, "id", &t->id, reason)) return false;
+    if (!importInt(row, "patientId", &t->patientId, reason)) return false;
+    if (!importInt(row, "appointmentId", &t->appointmentId, reason)) return false;
+    if (t->patientId <= 0 || t->appointmentId <= 0) { *reason = "patientId and appointmentId must be positive"; return false; }
+
+    t->notes = row.text("notes").trimmed().toStdString();
+    t->medications.clear();
+    for (const QString &m : row.list("medications"))
+        t->medications.push_back(m.toStdString());
+    return true;
+}
+
+QStringList parseCsvRecord(const QString &record) {
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i = 0; i < record.size(); ++i) {
+        QChar c = record[i];
+        if (quoted) {
+            if (c == '"') {
+                if (i + 1 < record.size() && record[i + 1] == '"') {
+                    field += '"';
+                    ++i;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields << field;
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+    fields << field;
+    return fields;
+}
+
+bool readImportRecord(QFile &file, bool csv, QString *record) {
+    record->clear();
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine());
+        while (line.endsWith('\n') || line.endsWith('\r')) line.chop(1);
+        if (record->isEmpty() && line.trimmed().isEmpty()) continue;
+        if (!record->isEmpty()) *record += '\n';
+        *record += line;
+        if (!csv || record->count('"') % 2 == 0) return true;
+    }
+    return !record->isEmpty();
+}
+
+ImportFingerprint fingerprintImportFile(QFile &file) {
+    ImportFingerprint f;
+    f.size = file.size();
+    f.modified = QFileInfo(file).lastModified().toMSecsSinceEpoch();
+    qint64 pos = file.pos();
+    file.seek(0);
+    f.headHash = QString::fromLatin1(QCryptographicHash::hash(file.read(64 * 1024), QCryptographicHash::Sha1).toHex());
+    file.seek(pos);
+    return f;
+}
+
+bool loadImportCheckpoint(QSqlDatabase &db, const QString &key, ClinicTable table,
+                          const ImportFingerprint &f, ImportCheckpoint *cp) {
+    QSqlQuery query(db);
+    query.prepare("SELECT tableName, fileSize, fileModified, headHash, byteOffset, rowsImported, rowsRejected, "
+                  "recordNumber, rejectsSize FROM ImportState WHERE path=?");
+    query.addBindValue(key);
+    if (!execTimed(query, "import.loadState") || !query.next()) return false;
+    if (query.value(0).toString() != tableName(table) || query.value(1).toLongLong() != f.size ||
+        query.value(2).toLongLong() != f.modified || query.value(3).toString() != f.headHash) {
+        writeLog("Not resuming import of " + key + ": the file or target table changed since it was interrupted",
+                 LogLevel::Warning);
+        return false;
+    }
+    cp->offset = query.value(4).toLongLong();
+    cp->rowsImported = query.value(5).toLongLong();
+    cp->rowsRejected = query.value(6).toLongLong();
+    cp->recordNumber = query.value(7).toLongLong();
+    cp->rejectsSize = query.value(8).toLongLong();
+    return true;
+}
+
+void clearImportCheckpoint(QSqlDatabase &db, const QString &key) {
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM ImportState WHERE path=?");
+    query.addBindValue(key);
+    execTimed(query, "import.clearState");
+}
+
+ImportResult importFile(QSqlDatabase &db, ClinicTable table, const QString &path,
+                        const std::function<void(const ImportProgress &)> &progress,
+                        const std::atomic<bool> *cancel, int chunkRows) {
+    ImportResult result;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        result.error = "Cannot open " + path;
+        return result;
+    }
+    bool csv = path.endsWith(".csv", Qt::CaseInsensitive);
+
+    QHash<QString, int> columns;
+    if (csv) {
+        QString header;
+        if (!readImportRecord(file, true, &header)) {
+            result.error = "Missing CSV header";
+            return result;
+        }
+        QStringList names = parseCsvRecord(header);
+        for (int i = 0; i < names.size(); ++i)
+            columns.insert(names[i].trimmed(), i);
+    }
+
+    QString stateKey = QFileInfo(path).absoluteFilePath();
+    ImportFingerprint fingerprint = fingerprintImportFile(file);
+    ImportCheckpoint cp;
+    bool resuming = loadImportCheckpoint(db, stateKey, table, fingerprint, &cp) &&
+                    cp.offset >= file.pos() && cp.offset <= fingerprint.size;
+    if (resuming) {
+        file.seek(cp.offset);
+        writeLog(QString("Resuming import of %1 at record %2").arg(path).arg(cp.recordNumber));
+    } else {
+        cp = ImportCheckpoint();
+    }
+
+    // Rejects past the checkpointed length belong to a chunk that never
+    // committed and are written again when it is re-read.
+    QFile rejects(path + ".rejects");
+    QIODevice::OpenMode rejectMode = QIODevice::WriteOnly | QIODevice::Text;
+    rejectMode |= resuming ? QIODevice::Append : QIODevice::Truncate;
+    if (!rejects.open(rejectMode) || (resuming && !rejects.resize(cp.rejectsSize))) {
+        result.error = "Cannot open reject file for " + path;
+        return result;
+    }
+
+    QSqlQuery saveState(db);
+    saveState.prepare("INSERT OR REPLACE INTO ImportState (path, tableName, fileSize, fileModified, headHash, "
+                      "byteOffset, rowsImported, rowsRejected, recordNumber, rejectsSize) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+
+    Repositories &repos = repositoriesFor(db);
+    auto insertRow = [&](const ImportRow &row, QString *reason) {
+        switch (table) {
+        case ClinicTable::Patients: {
+            Patient p;
+            return rowToPatient(row, &p, reason) && repos.patients.insertWithId(p, reason);
+        }
+        case ClinicTable::Appointments: {
+            Appointment a;
+            return rowToAppointment(row, &a, reason) && repos.appointments.insertWithId(a, reason);
+        }
+        case ClinicTable::Treatments: {
+            Treatment t;
+            return rowToTreatment(row, &t, reason) && repos.treatments.insertWithId(t, reason);
+        }
+        }
+        return false;
+    };
+
+    QString record;
+    ImportRow row;
+    if (csv) row.columns = &columns;
+    bool atEnd = false;
+
+    while (!atEnd) {
+        if (cancel && cancel->load()) {
+            result.cancelled = true;
+            break;
+        }
+
+        qint64 chunkImported = 0;
+        qint64 chunkRejected = 0;
+        qint64 chunkRecords = 0;
+        QByteArray chunkRejects;
+
+        if (!db.transaction()) {
+            result.error = "Failed to begin transaction: " + db.lastError().text();
+            break;
+        }
+        size_t changeMark = repos.changes.begin();
+        while (chunkRecords < chunkRows) {
+            if (!readImportRecord(file, csv, &record)) {
+                atEnd = true;
+                break;
+            }
+            ++chunkRecords;
+
+            QString reason;
+            bool parsed = true;
+            if (csv) {
+                row.fields = parseCsvRecord(record);
+            } else {
+                QJsonParseError parseError;
+                QJsonDocument doc = QJsonDocument::fromJson(record.toUtf8(), &parseError);
+                parsed = doc.isObject();
+                if (!parsed) reason = parseError.error != QJsonParseError::NoError ? parseError.errorString() : "not a JSON object";
+                row.json = doc.object();
+            }
+
+            if (parsed && insertRow(row, &reason)) {
+                ++chunkImported;
+            } else {
+                ++chunkRejected;
+                chunkRejects += QString("%1\t%2\t%3\n").arg(cp.recordNumber + chunkRecords).arg(reason, record).toUtf8();
+            }
+        }
+
+        // The rejects are on disk and the checkpoint is in the chunk's
+        // transaction before it commits, so a crash at any point resumes
+        // at a chunk boundary without importing a row twice.
+        ImportCheckpoint next = cp;
+        next.offset = file.pos();
+        next.rowsImported += chunkImported;
+        next.rowsRejected += chunkRejected;
+        next.recordNumber += chunkRecords;
+        bool rejectsWritten = rejects.write(chunkRejects) == chunkRejects.size() && rejects.flush();
+        next.rejectsSize = rejects.size();
+
+        QVariantList state{stateKey, tableName(table), fingerprint.size, fingerprint.modified, fingerprint.headHash,
+                           next.offset, next.rowsImported, next.rowsRejected, next.recordNumber, next.rejectsSize};
+        for (int i = 0; i < state.size(); ++i) saveState.bindValue(i, state[i]);
+        if (!rejectsWritten)
+            result.error = "Failed to write " + rejects.fileName() + ": " + rejects.errorString();
+        else if (!execTimed(saveState, "import.saveState"))
+            result.error = "Failed to save import checkpoint: " + saveState.lastError().text();
+        else if (!db.commit())
+            result.error = "Failed to commit import chunk: " + db.lastError().text();
+        if (!result.error.isEmpty()) {
+            db.rollback();
+            repos.changes.rollback(changeMark);
+            break;
+        }
+        repos.changes.commit();
+        cp = next;
+
+        if (progress) progress(ImportProgress{cp.offset, file.size(), cp.rowsImported, cp.rowsRejected});
+    }
+
+    result.rowsImported = cp.rowsImported;
+    result.rowsRejected = cp.rowsRejected;
+    result.ok = atEnd && result.error.isEmpty();
+    if (result.ok) {
+        clearImportCheckpoint(db, stateKey);
+        if (cp.rowsRejected == 0) {
+            rejects.close();
+            rejects.remove();
+        }
+    }
+    writeLog(QString("Import of %1: %2 rows imported, %3 rejected%4")
+             .arg(path).arg(result.rowsImported).arg(result.rowsRejected)
+             .arg(result.ok ? "" : " (incomplete: " + (result.cancelled ? QString("cancelled") : result.error) + ")"),
+             result.ok ? LogLevel::Info : LogLevel::Warning);
+    return result;
+}
+
+QThread *runInBackground(const QString &connectionName, std::function<void(QSqlDatabase &)> job) {
+    QThread *thread = QThread::create([connectionName, job]() {
+        {
+            QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+            db.setDatabaseName(kDatabaseFile);
+            if (openConfiguredConnection(db)) {
+                job(db);
+            } else {
+                writeLog("Background job failed to open database: " + db.lastError().text(), LogLevel::Error);
+            }
+            releaseRepositories(db);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+    });
+    QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+    thread->start();
+    return thread;
+}
+
+// --- Export ---
+
+QByteArray csvField(const QString &value) {
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n') && !value.contains('\r'))
+        return value.toUtf8();
+    QString quoted = value;
+    quoted.replace("\"", "\"\"");
+    return ("\"" + quoted + "\"").toUtf8();
+}
+
+ExportResult exportTable(QSqlDatabase &db, ClinicTable table, ExportFormat format, const QString &path,
+                         const std::function<void(qint64 rows, qint64 total)> &progress,
+                         const std::atomic<bool> *cancel) {
+    static const QHash<int, QStringList> columnsByTable = {
+        {int(ClinicTable::Patients), {"id", "name", "age", "contact", "medicalHistory"}},
+        {int(ClinicTable::Appointments), {"id", "patientId", "date", "time", "purpose", "completed", "duration"}},
+        {int(ClinicTable::Treatments), {"id", "patientId", "appointmentId", "notes", "medications"}}
+    };
+    const QStringList columns = columnsByTable.value(int(table));
+    const QString name = tableName(table);
+
+    ExportResult result;
+    qint64 total = 0;
+    QSqlQuery count(db);
+    count.prepare("SELECT COUNT(*) FROM " + name);
+    if (execTimed(count, "export.count") && count.next()) total = count.value(0).toLongLong();
+    count.finish();
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString("SELECT %1 FROM %2 ORDER BY id").arg(columns.join(", "), name));
+    if (!execTimed(query, "export.rows")) {
+        result.error = "Failed to read " + name + ": " + query.lastError().text();
+        return result;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        result.error = "Cannot write " + path + ": " + file.errorString();
+        return result;
+    }
+
+    QByteArray buffer;
+    if (format == ExportFormat::Csv) buffer += columns.join(",").toUtf8() + "\n";
+
+    while (query.next()) {
+        if (format == ExportFormat::Csv) {
+            for (int c = 0; c < columns.size(); ++c) {
+                if (c) buffer += ',';
+                buffer += csvField(query.value(c).toString());
+            }
+            buffer += '\n';
+        } else {
+            QJsonObject obj;
+            for (int c = 0; c < columns.size(); ++c) {
+                const QString &col = columns[c];
+                QVariant v = query.value(c);
+                if (col == "medications") {
+                    QJsonArray meds;
+                    for (const QString &m : splitMedications(v.toString()))
+                        meds.append(m);
+                    obj.insert(col, meds);
+                } else if (col == "completed") {
+                    obj.insert(col, v.toInt() != 0);
+                } else if (col == "id" || col == "age" || col == "duration" || col.endsWith("Id")) {
+                    obj.insert(col, v.toInt());
+                } else {
+                    obj.insert(col, v.toString());
+                }
+            }
+            buffer += QJsonDocument(obj).toJson(QJsonDocument::Compact);
+            buffer += '\n';
+        }
+
+        ++result.rows;
+        if (buffer.size() >= 1 << 16) {
+            if (file.write(buffer) != buffer.size()) break;
+            buffer.clear();
+        }
+        if (result.rows % 5000 == 0) {
+            if (cancel && cancel->load()) {
+                result.cancelled = true;
+                break;
+            }
+            if (progress) progress(result.rows, total);
+        }
+    }
+    query.finish();
+
+    if (result.cancelled) {
+        file.cancelWriting();
+        return result;
+    }
+
+    // commit() fails if any write did, and only then replaces the previous export.
+    if (file.write(buffer) != buffer.size() || !file.commit()) {
+        result.error = "Cannot write " + path + ": " + file.errorString();
+        return result;
+    }
+    if (progress) progress(result.rows, total);
+    result.ok = true;
+    return result;
+}
+
+// --- Online backup ---
+
+BackupSettings loadBackupSettings() {
+    QSettings settings(kSettingsOrganization, kSettingsApplication);
+    BackupSettings b;
+    b.directory = settings.value("backup/directory", b.directory).toString();
+    b.keep = std::max(1, settings.value("backup/keep", b.keep).toInt());
+    b.intervalHours = std::max(0, settings.value("backup/intervalHours", b.intervalHours).toInt());
+    b.pagesPerStep = std::max(1, settings.value("backup/pagesPerStep", b.pagesPerStep).toInt());
+    b.pauseMs = std::max(0, settings.value("backup/pauseMs", b.pauseMs).toInt());
+    return b;
+}
+
+#ifdef CLINIC_SYSTEM_SQLITE
+// The sqlite3 handle behind a QSQLITE connection, or nullptr.
+sqlite3 *sqliteHandle(QSqlDatabase &db) {
+    QVariant v = db.driver() ? db.driver()->handle() : QVariant();
+    if (!v.isValid() || qstrcmp(v.typeName(), "sqlite3*") != 0) return nullptr;
+    return *static_cast<sqlite3 **>(v.data());
+}
+
+// True when the QSQLITE driver runs the SQLite library this program links,
+// which is what makes sqliteHandle() safe to use.
+bool sqliteLibraryMatches(QSqlDatabase &db, QString *error) {
+    QSqlQuery query(db);
+    QString driverVersion = query.exec("SELECT sqlite_version()") && query.next() ? query.value(0).toString() : QString();
+    if (sqliteHandle(db) && driverVersion == QLatin1String(sqlite3_libversion())) return true;
+    *error = QString("QSQLITE uses SQLite %1 but the app links SQLite %2; CLINIC_SYSTEM_SQLITE "
+                     "needs a Qt configured with -system-sqlite")
+             .arg(driverVersion.isEmpty() ? QString("(unknown)") : driverVersion, sqlite3_libversion());
+    return false;
+}
+
+// A write by another connection makes SQLite restart the copy from page 1,
+// so on a busy database the batched copy might never finish. After this many
+// restarts the rest is copied in one step, which holds the read lock longer
+// but always completes.
+const int kMaxBackupRestarts = 3;
+
+// Copies the main database of `from` into `to`, pagesPerStep pages at a time.
+// Each step is timed; the slowest one is how long `from` was held locked.
+bool copyDatabase(sqlite3 *from, sqlite3 *to, int pagesPerStep, int pauseMs, BackupReport *report) {
+    sqlite3_backup *backup = sqlite3_backup_init(to, "main", from, "main");
+    if (!backup) {
+        report->error = QString::fromUtf8(sqlite3_errmsg(to));
+        return false;
+    }
+
+    int rc;
+    int busyRetries = 0;
+    int lastRemaining = -1;
+    do {
+        QElapsedTimer step;
+        step.start();
+        rc = sqlite3_backup_step(backup, report->restarts >= kMaxBackupRestarts ? -1 : pagesPerStep);
+        report->maxLockUs = std::max(report->maxLockUs, step.nsecsElapsed() / 1000);
+
+        int remaining = sqlite3_backup_remaining(backup);
+        if (lastRemaining >= 0 && remaining > lastRemaining) ++report->restarts;
+        lastRemaining = remaining;
+
+        // Busy or locked means another connection holds a conflicting lock;
+        // back off a little more each time and give up after about 15 s.
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            ++busyRetries;
+            QThread::msleep(std::min(10 * busyRetries, 250));
+        } else {
+            busyRetries = 0;
+            if (rc == SQLITE_OK && pauseMs > 0) QThread::msleep(pauseMs);
+        }
+    } while ((rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && busyRetries < 100);
+
+    sqlite3_backup_finish(backup);
+    if (rc != SQLITE_DONE) {
+        report->error = busyRetries > 0 ? QString("database stayed locked") : QString::fromUtf8(sqlite3_errstr(rc));
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool writeSnapshot(QSqlDatabase &source, const QString &path, const BackupSettings &settings, BackupReport *report) {
+#ifdef CLINIC_SYSTEM_SQLITE
+    sqlite3 *from = sqliteHandle(source);
+    if (!from) {
+        report->error = "not a SQLite connection";
+        return false;
+    }
+    sqlite3 *to = nullptr;
+    bool ok = false;
+    if (sqlite3_open_v2(path.toUtf8().constData(), &to, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK)
+        report->error = QString::fromUtf8(sqlite3_errmsg(to));
+    else
+        ok = copyDatabase(from, to, settings.pagesPerStep, settings.pauseMs, report);
+    sqlite3_close(to);
+    return ok;
+#else
+    // One read transaction for the whole copy. In WAL mode writers carry on
+    // meanwhile; with a rollback journal they wait until it ends.
+    Q_UNUSED(settings);
+    QSqlQuery query(source);
+    query.prepare("VACUUM INTO ?");
+    query.addBindValue(path);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = execTimed(query, "backup.vacuumInto");
+    report->maxLockUs = timer.nsecsElapsed() / 1000;
+    if (!ok) report->error = query.lastError().text();
+    return ok;
+#endif
+}
+
+// Opens the database file at path on its own connection and runs job on it.
+template <typename Job>
+bool withDatabaseFile(const QString &path, const QString &connectionName, QString *error, Job job) {
+    bool ok = false;
+    {
+        QSqlDatabase file = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        file.setDatabaseName(path);
+        if (!file.open()) {
+            *error = file.lastError().text();
+        } else {
+            ok = job(file);
+            file.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    return ok;
+}
+
+bool integrityOk(QSqlDatabase &db, QString *error) {
+    QSqlQuery query(db);
+    query.prepare("PRAGMA integrity_check");
+    if (!execTimed(query, "backup.integrityCheck")) {
+        *error = query.lastError().text();
+        return false;
+    }
+    QStringList problems;
+    while (query.next()) {
+        if (query.value(0).toString() != "ok") problems << query.value(0).toString();
+    }
+    if (!problems.isEmpty()) *error = "integrity check failed: " + problems.join("; ");
+    return problems.isEmpty();
+}
+
+QStringList listBackups(const QString &dir, const QStringList &patterns) {
+    QStringList paths;
+    for (const QString &name : QDir(dir).entryList(patterns, QDir::Files, QDir::Time))
+        paths << QDir(dir).filePath(name);
+    return paths;
+}
+
+void pruneBackups(const QString &dir, int keep) {
+    QStringList paths = listBackups(dir);
+    for (int i = keep; i < paths.size(); ++i) {
+        if (QFile::remove(paths[i])) writeLog("Removed old backup " + paths[i], LogLevel::Debug);
+    }
+}
+
+BackupReport backupDatabase(QSqlDatabase &source, const BackupSettings &settings,
+                            const QString &prefix) {
+    BackupReport report;
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir().mkpath(settings.directory);
+    report.path = QDir(settings.directory).filePath(
+        prefix + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss") + ".db");
+    QString partial = report.path + ".partial";
+    QFile::remove(partial);
+
+    report.ok = writeSnapshot(source, partial, settings, &report) &&
+                withDatabaseFile(partial, source.connectionName() + "_check", &report.error,
+                                 [&](QSqlDatabase &snapshot) { return integrityOk(snapshot, &report.error); });
+    if (report.ok && !QFile::rename(partial, report.path)) {
+        report.ok = false;
+        report.error = "could not rename " + partial;
+    }
+    if (!report.ok) QFile::remove(partial);
+    report.bytes = report.ok ? QFileInfo(report.path).size() : 0;
+    report.elapsedMs = timer.elapsed();
+    writeLog(report.summary(), report.ok ? LogLevel::Info : LogLevel::Error);
+
+    if (report.ok && settings.keep > 0) pruneBackups(settings.directory, settings.keep);
+    return report;
+}
+
+BackupReport restoreDatabase(QSqlDatabase &target, const QString &snapshotPath) {
+    BackupReport report;
+    report.path = snapshotPath;
+    QElapsedTimer timer;
+    timer.start();
+
+    QTemporaryDir scratchDir;
+    QString scratch = scratchDir.filePath("snapshot.db");
+    BackupSettings settings = loadBackupSettings();
+    settings.keep = 0;
+
+    auto prepareSnapshot = [&](QSqlDatabase &snapshot) {
+        if (!integrityOk(snapshot, &report.error)) return false;
+        int version = schemaVersion(snapshot);
+        if (version > kSchemaVersion) {
+            report.error = "the snapshot was written by a newer version of the app";
+            return false;
+        }
+        if (version < kSchemaVersion) {
+            createTables(snapshot);
+            if (!migrateSchema(snapshot)) {
+                report.error = "could not upgrade the snapshot's schema";
+                return false;
+            }
+        }
+        return true;
+    };
+
+    static const char *copySteps[] = {
+        "DELETE FROM ImportState",
+        "DELETE FROM Treatments",
+        "DELETE FROM TreatmentMedications",
+        "DELETE FROM Appointments",
+        "DELETE FROM Patients",
+        "INSERT INTO Patients (id, name, age, contact, medicalHistory) "
+        "SELECT id, name, age, contact, medicalHistory FROM snapshot.Patients",
+        "INSERT INTO Appointments (id, patientId, date, time, purpose, completed, duration) "
+        "SELECT id, patientId, date, time, purpose, completed, duration FROM snapshot.Appointments",
+        "INSERT INTO Treatments (id, patientId, appointmentId, notes, medications) "
+        "SELECT id, patientId, appointmentId, notes, medications FROM snapshot.Treatments",
+        "INSERT INTO TreatmentMedications (treatmentId, name) "
+        "SELECT treatmentId, name FROM snapshot.TreatmentMedications"
+    };
+
+    if (!scratchDir.isValid() || !QFile::copy(snapshotPath, scratch)) {
+        report.error = "could not copy " + snapshotPath;
+    } else if (withDatabaseFile(scratch, target.connectionName() + "_snapshot", &report.error, prepareSnapshot)) {
+        BackupReport safety = backupDatabase(target, settings, "pre-restore-");
+        QSqlQuery query(target);
+        query.prepare("ATTACH DATABASE ? AS snapshot");
+        query.addBindValue(scratch);
+        if (!safety.ok) {
+            report.error = "could not back up the current data first: " + safety.error;
+        } else if (!query.exec()) {
+            report.error = query.lastError().text();
+        } else {
+            // busy_timeout already waits inside each attempt; back off between
+            // attempts for writers that hold on longer.
+            int attempt = 0;
+            while (!query.exec("BEGIN IMMEDIATE") && ++attempt < 10) QThread::msleep(200 * attempt);
+            if (attempt >= 10) {
+                report.error = "database stayed locked: " + query.lastError().text();
+            } else {
+                QElapsedTimer locked;
+                locked.start();
+                report.ok = true;
+                for (const char *sql : copySteps) {
+                    query.prepare(sql);
+                    if (!execTimed(query, "restore.copy")) {
+                        report.ok = false;
+                        report.error = query.lastError().text();
+                        break;
+                    }
+                }
+                query.exec(report.ok ? "COMMIT" : "ROLLBACK");
+                report.maxLockUs = locked.nsecsElapsed() / 1000;
+            }
+            query.exec("DETACH DATABASE snapshot");
+        }
+    }
+
+    report.bytes = report.ok ? QFileInfo(snapshotPath).size() : 0;
+    report.elapsedMs = timer.elapsed();
+    writeLog(report.ok ? "Restored " + report.summary() : "Restore of " + snapshotPath + " failed: " + report.error,
+             report.ok ? LogLevel::Info : LogLevel::Error);
+    return report;
+}
+
+// --- Reports ---
+
+ClinicReport computeReport(const ReportSnapshot &s, const QDate &from, const QDate &to, int threads) {
+    QElapsedTimer timer;
+    timer.start();
+    ClinicReport report;
+    report.from = from;
+    report.to = to;
+    const qint32 first = qint32(from.toJulianDay());
+    const quint32 span = from <= to ? quint32(from.daysTo(to) + 1) : 0;
+    const size_t rows = s.apptId.size();
+    const size_t purposeCount = s.purposes.size();
+    const size_t patientSlots = s.patientCount() + 1;   // slot 0 is the discard slot
+
+    struct Partial {
+        std::vector<int> visits, completed, treated, purposes;
+        std::array<int, 25> hours{};
+        std::vector<quint32> perPatient;
+    };
+    if (threads <= 0) threads = int(std::clamp(std::thread::hardware_concurrency(), 1u, 8u));
+    if (rows < 50000) threads = 1;
+    report.threads = threads;
+    std::vector<Partial> partials(threads);
+
+    auto work = [&](int t) {
+        Partial &p = partials[t];
+        p.visits.assign(span + 1, 0);
+        p.completed.assign(span + 1, 0);
+        p.treated.assign(span + 1, 0);
+        p.purposes.assign(purposeCount + 1, 0);
+        p.perPatient.assign(patientSlots, 0);
+        size_t begin = rows * t / threads;
+        size_t end = rows * (t + 1) / threads;
+        const qint32 *day = s.apptDay.data();
+        const qint16 *minute = s.apptMinute.data();
+        const qint32 *patient = s.apptPatient.data();
+        const qint32 *purpose = s.apptPurpose.data();
+        const quint8 *done = s.apptCompleted.data();
+        const quint8 *treated = s.apptTreated.data();
+        const quint8 *alive = s.apptAlive.data();
+        for (size_t i = begin; i < end; ++i) {
+            quint32 offset = quint32(day[i] - first);
+            bool in = (offset < span) & (alive[i] != 0);
+            quint32 slot = in ? offset : span;
+            p.visits[slot] += 1;
+            p.completed[slot] += done[i];
+            p.treated[slot] += treated[i];
+            p.hours[in && minute[i] >= 0 ? minute[i] / 60 : 24] += 1;
+            p.purposes[in ? size_t(purpose[i]) : purposeCount] += 1;
+            p.perPatient[in ? size_t(patient[i]) : 0] += 1;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(work, t);
+    work(0);
+    for (std::thread &thread : pool) thread.join();
+
+    report.visits.assign(span, 0);
+    report.completed.assign(span, 0);
+    report.treated.assign(span, 0);
+    std::vector<int> purposeVisits(purposeCount, 0);
+    for (const Partial &p : partials) {
+        for (quint32 d = 0; d < span; ++d) {
+            report.visits[d] += p.visits[d];
+            report.completed[d] += p.completed[d];
+            report.treated[d] += p.treated[d];
+        }
+        for (int h = 0; h < 24; ++h) report.visitsByHour[h] += p.hours[h];
+        for (size_t c = 0; c < purposeCount; ++c) purposeVisits[c] += p.purposes[c];
+    }
+    for (size_t id = 1; id < patientSlots; ++id) {
+        quint32 n = 0;
+        for (const Partial &p : partials) n += p.perPatient[id];
+        if (n > 0) ++report.patientsByVisits[n == 1 ? 0 : n == 2 ? 1 : n <= 5 ? 2 : 3];
+    }
+    for (size_t c = 0; c < purposeCount; ++c)
+        if (purposeVisits[c] > 0) report.purposes.emplace_back(s.purposes[c], purposeVisits[c]);
+    std::sort(report.purposes.begin(), report.purposes.end(),
+              [](const auto &a, const auto &b) { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+
+    report.computeUs = timer.nsecsElapsed() / 1000;
+    return report;
+}
+
+QString percentText(int part, int whole) {
+    return whole > 0 ? QString::number(part * 100.0 / whole, 'f', 1) : QString("0.0");
+}
+
+ReportTable reportTable(const ClinicReport &r, ReportKind kind, bool byWeek) {
+    ReportTable table;
+    switch (kind) {
+    case ReportKind::Visits: {
+        table.header = {byWeek ? "Week of" : "Date", "Visits", "Completed", "Completion %", "With treatment"};
+        for (size_t d = 0; d < r.visits.size();) {
+            QDate date = r.from.addDays(qint64(d));
+            // A week runs Monday to Sunday; the first one may be partial.
+            size_t days = byWeek ? size_t(8 - date.dayOfWeek()) : 1;
+            int visits = 0, completed = 0, treated = 0;
+            for (size_t end = std::min(d + days, r.visits.size()); d < end; ++d) {
+                visits += r.visits[d];
+                completed += r.completed[d];
+                treated += r.treated[d];
+            }
+            table.rows.push_back({date.toString("yyyy-MM-dd"), QString::number(visits), QString::number(completed),
+                                  percentText(completed, visits), QString::number(treated)});
+        }
+        break;
+    }
+    case ReportKind::Hours:
+        table.header = {"Hour", "Visits"};
+        for (int h = 0; h < 24; ++h)
+            if (r.visitsByHour[h] > 0)
+                table.rows.push_back({QString("%1:00").arg(h, 2, 10, QChar('0')), QString::number(r.visitsByHour[h])});
+        break;
+    case ReportKind::Purposes: {
+        table.header = {"Purpose", "Visits", "Share %"};
+        int visits = r.total(r.visits);
+        for (const auto &p : r.purposes)
+            table.rows.push_back({p.first, QString::number(p.second), percentText(p.second, visits)});
+        break;
+    }
+    case ReportKind::RepeatVisits: {
+        table.header = {"Visits per patient", "Patients"};
+        const char *labels[] = {"1", "2", "3-5", "6+"};
+        for (int i = 0; i < 4; ++i) table.rows.push_back({labels[i], QString::number(r.patientsByVisits[i])});
+        break;
+    }
+    }
+    return table;
+}
+
+void writeReportCsv(const ReportTable &table, QIODevice *out) {
+    QByteArrayList fields;
+    for (const QString &h : table.header) fields << csvField(h);
+    out->write(fields.join(',') + "\n");
+    for (const QStringList &row : table.rows) {
+        fields.clear();
+        for (const QString &value : row) fields << csvField(value);
+        out->write(fields.join(',') + "\n");
+    }
+}
+
+bool parseReportKind(const QString &name, ReportKind *kind) {
+    static const std::pair<const char *, ReportKind> kinds[] = {
+        {"visits", ReportKind::Visits}, {"hours", ReportKind::Hours},
+        {"purposes", ReportKind::Purposes}, {"repeat", ReportKind::RepeatVisits}};
+    for (const auto &k : kinds) {
+        if (name.compare(k.first, Qt::CaseInsensitive) == 0) {
+            *kind = k.second;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,2124 @@
+// Data layer shared by the clinic app (main.cpp) and the benchmark (bench.cpp):
+// records, logging, query metrics, connection setup, schema, repositories,
+// scheduling, search, patient lookup, import/export, backups and reports.
+// Nothing here depends on QtWidgets.
+#ifndef CLINIC_DATA_H
+#define CLINIC_DATA_H
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QBuffer>
+#include <QtCore/QTextStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QThread>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDir>
+#include <QtCore/QTimer>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QSettings>
+#include <QtCore/QPointer>
+#include <QtCore/QSet>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QJsonArray>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+
+#include <string>
+#include <vector>
+#include <array>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <cctype>
+
+const char kDatabaseFile[] = "clinic.db";
+
+// --- Structs ---
+struct Patient {
+    int id;
+    std::string name;
+    int age;
+    std::string contact;
+    std::string medicalHistory;
+};
+
+// The id and display name of a patient, as listed in patientListWidget.
+struct PatientSummary {
+    int id;
+    QString name;
+};
+
+struct Appointment {
+    int id;
+    int patientId;
+    std::string date;
+    std::string time;
+    std::string purpose;
+    bool completed;
+    int durationMinutes = 30;
+};
+
+struct Treatment {
+    int id;
+    int patientId;
+    int appointmentId;
+    std::string notes;
+    std::vector<std::string> medications;
+};
+
+// A treatment as shown in the history list. Unlike Treatment it keeps the
+// QString values read from the database, so nothing is converted on the way
+// to the widgets.
+struct TreatmentRow {
+    int id;
+    int patientId;
+    int appointmentId;
+    QString notes;
+    QStringList medications;
+};
+
+// --- Logging ---
+enum class LogLevel { Debug, Info, Warning, Error };
+
+// Background logger for clinic_debug.log. Callers only append to an in-memory
+// queue; a worker thread owns the file, writes records in batches and rotates
+// the log once it grows past kMaxFileBytes.
+class Logger {
+public:
+    static Logger &instance() {
+        static Logger logger("clinic_debug.log");
+        return logger;
+    }
+
+    ~Logger() { shutdown(); }
+
+    void setMinimumLevel(LogLevel level) { minimumLevel.store(level); }
+
+    void log(LogLevel level, const QString &message) {
+        if (level < minimumLevel.load()) return;
+        bool wakeWorker = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            pending.push_back(Record{QDateTime::currentMSecsSinceEpoch(), level, message});
+            wakeWorker = pending.size() >= kFlushBatch;
+        }
+        if (wakeWorker) wake.notify_one();
+    }
+
+    // Writes out everything queued so far and stops the worker. Safe to call
+    // more than once.
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+private:
+    struct Record {
+        qint64 timestamp;
+        LogLevel level;
+        QString message;
+    };
+
+    static constexpr size_t kFlushBatch = 64;
+    static constexpr int kFlushIntervalMs = 500;
+    static constexpr qint64 kMaxFileBytes = 5 * 1024 * 1024;
+    static constexpr int kKeptFiles = 3;
+
+    explicit Logger(const QString &path) : path(path) {
+        worker = std::thread([this]() { run(); });
+    }
+
+    static const char *levelName(LogLevel level) {
+        switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO";
+        case LogLevel::Warning: return "WARN";
+        case LogLevel::Error: return "ERROR";
+        }
+        return "INFO";
+    }
+
+    void rotate(QFile &file) {
+        file.close();
+        for (int i = kKeptFiles - 1; i >= 1; --i) {
+            QString from = QString("%1.%2").arg(path).arg(i);
+            QString to = QString("%1.%2").arg(path).arg(i + 1);
+            QFile::remove(to);
+            QFile::rename(from, to);
+        }
+        QFile::remove(path + ".1");
+        QFile::rename(path, path + ".1");
+        file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+    }
+
+    void run() {
+        QFile file(path);
+        file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+        std::vector<Record> batch;
+
+        for (;;) {
+            bool done;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(kFlushIntervalMs),
+                              [this]() { return stopping || pending.size() >= kFlushBatch; });
+                batch.swap(pending);
+                done = stopping;
+            }
+
+            if (!batch.empty() && file.isOpen()) {
+                QByteArray out;
+                for (const Record &r : batch) {
+                    out += QDateTime::fromMSecsSinceEpoch(r.timestamp).toString("yyyy-MM-dd HH:mm:ss.zzz").toUtf8();
+                    out += ' ';
+                    out += levelName(r.level);
+                    out += ' ';
+                    out += r.message.toUtf8();
+                    out += '\n';
+                }
+                file.write(out);
+                file.flush();
+                if (file.size() > kMaxFileBytes) rotate(file);
+            }
+            batch.clear();
+            if (done) break;
+        }
+    }
+
+    QString path;
+    std::atomic<LogLevel> minimumLevel{LogLevel::Info};
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Record> pending;
+    bool stopping = false;
+    std::thread worker;
+};
+
+void writeLog(const QString &message, LogLevel level = LogLevel::Info);
+
+// --- Query metrics ---
+// Counts and latency histograms per statement key ("patients.page", ...) and
+// per UI refresh ("ui.refreshPatients", ...). Statements are recorded by
+// execTimed(), which also logs anything slower than the threshold.
+struct LatencyStats {
+    // Bucket i counts latencies in [2^i, 2^(i+1)) microseconds; the last one
+    // collects everything from ~8 s up.
+    static constexpr int kBuckets = 24;
+
+    quint64 count = 0;
+    quint64 failures = 0;
+    qint64 totalUs = 0;
+    qint64 maxUs = 0;
+    qint64 lastUs = 0;
+    quint64 buckets[kBuckets] = {};
+
+    void add(qint64 us, bool ok) {
+        ++count;
+        if (!ok) ++failures;
+        totalUs += us;
+        lastUs = us;
+        maxUs = std::max(maxUs, us);
+        int bucket = 0;
+        while (bucket < kBuckets - 1 && (qint64(2) << bucket) <= us) ++bucket;
+        ++buckets[bucket];
+    }
+
+    // Upper bound of the bucket holding the p-th percentile, in microseconds.
+    qint64 percentileUs(int p) const {
+        if (count == 0) return 0;
+        quint64 rank = (count * p + 99) / 100;
+        quint64 seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(qint64(2) << i, maxUs);
+        }
+        return maxUs;
+    }
+};
+
+class QueryMetrics {
+public:
+    static QueryMetrics &instance() {
+        static QueryMetrics metrics;
+        return metrics;
+    }
+
+    void record(const QString &key, qint64 us, bool ok = true) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats[key].add(us, ok);
+        if (us >= slowThresholdMs.load() * 1000) ++slowCount;
+    }
+
+    std::map<QString, LatencyStats> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    quint64 slowQueries() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return slowCount;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.clear();
+        slowCount = 0;
+    }
+
+    int slowThreshold() const { return slowThresholdMs.load(); }
+    void setSlowThreshold(int ms) { slowThresholdMs.store(std::max(1, ms)); }
+
+    // One line for the status bar: statement totals plus the latest UI timings.
+    QString summary() const {
+        std::map<QString, LatencyStats> all = snapshot();
+        LatencyStats queries;
+        QStringList ui;
+        for (const auto &entry : all) {
+            if (entry.first.startsWith("ui.")) {
+                ui << QString("%1 %2 ms").arg(entry.first.mid(3)).arg(entry.second.lastUs / 1000.0, 0, 'f', 1);
+                continue;
+            }
+            queries.count += entry.second.count;
+            queries.totalUs += entry.second.totalUs;
+            queries.maxUs = std::max(queries.maxUs, entry.second.maxUs);
+            for (int i = 0; i < LatencyStats::kBuckets; ++i) queries.buckets[i] += entry.second.buckets[i];
+        }
+        QString line = QString("Queries %1, p95 %2 ms, slow %3")
+                       .arg(queries.count).arg(queries.percentileUs(95) / 1000.0, 0, 'f', 1).arg(slowQueries());
+        if (!ui.isEmpty()) line += " | " + ui.join(", ");
+        return line;
+    }
+
+    QJsonObject toJson() const {
+        QJsonObject root;
+        root.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+        root.insert("slow_threshold_ms", slowThreshold());
+        root.insert("slow_queries", QString::number(slowQueries()));
+        QJsonObject keys;
+        for (const auto &entry : snapshot()) {
+            const LatencyStats &s = entry.second;
+            QJsonObject obj;
+            obj.insert("count", QString::number(s.count));
+            obj.insert("failures", QString::number(s.failures));
+            obj.insert("mean_us", s.count ? double(s.totalUs) / s.count : 0.0);
+            obj.insert("p50_us", s.percentileUs(50));
+            obj.insert("p95_us", s.percentileUs(95));
+            obj.insert("p99_us", s.percentileUs(99));
+            obj.insert("max_us", s.maxUs);
+            obj.insert("last_us", s.lastUs);
+            QJsonArray histogram;
+            for (quint64 b : s.buckets) histogram.append(QString::number(b));
+            obj.insert("histogram_log2_us", histogram);
+            keys.insert(entry.first, obj);
+        }
+        root.insert("statements", keys);
+        return root;
+    }
+
+    bool dump(const QString &path) const {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            writeLog("Failed to write metrics to " + path, LogLevel::Error);
+            return false;
+        }
+        file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+        return true;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::map<QString, LatencyStats> stats;
+    quint64 slowCount = 0;
+    std::atomic<int> slowThresholdMs{100};
+};
+
+// Bound values for the slow-query log. Text is replaced by its length so no
+// names or medical notes reach the log; numbers are kept.
+QString redactedBindings(const QSqlQuery &query);
+
+// Executes a prepared query and records it under key. Only the execute step
+// is timed, which for SQLite includes producing the first row.
+bool execTimed(QSqlQuery &query, const QString &key);
+
+// --- Connection setup ---
+// PRAGMAs applied to every connection right after it opens. The active
+// profile is stored in QSettings and edited through File > Settings.
+struct SqliteProfile {
+    QString journalMode;   // WAL, DELETE or TRUNCATE
+    QString synchronous;   // OFF, NORMAL or FULL
+    int cacheSizeKiB;      // page cache per connection
+    qint64 mmapSizeBytes;  // 0 disables memory-mapped I/O
+    QString tempStore;     // DEFAULT, FILE or MEMORY
+    int busyTimeoutMs;     // how long a writer waits for a lock
+};
+
+// Named profiles offered in the settings dialog and compared by the benchmark.
+// "Qt default" matches what a plain QSQLITE connection uses: SQLite's own
+// defaults plus the driver's 5 s busy timeout.
+std::vector<std::pair<QString, SqliteProfile>> sqliteProfilePresets();
+
+SqliteProfile defaultSqliteProfile();
+
+const char kSettingsOrganization[] = "Leorio";
+const char kSettingsApplication[] = "Clinic";
+
+SqliteProfile loadSqliteProfile();
+
+void saveSqliteProfile(const SqliteProfile &p);
+
+// Failures are logged and, if error is set, collected there one per line.
+// A journal_mode that SQLite refuses to switch (e.g. leaving WAL while other
+// connections are open) counts as a failure.
+bool applySqliteProfile(QSqlDatabase &db, const SqliteProfile &p, QString *error = nullptr);
+
+// Opens db and applies the saved profile.
+bool openConfiguredConnection(QSqlDatabase &db);
+
+void createTables(QSqlDatabase &db);
+
+// --- Schema migrations ---
+// PRAGMA user_version records the last migration step applied to clinic.db.
+// Each step runs in its own transaction so a failed upgrade leaves the file
+// at the previous version.
+const int kSchemaVersion = 5;
+
+int schemaVersion(QSqlDatabase &db);
+
+bool migrateSchema(QSqlDatabase &db);
+
+// Prints EXPLAIN QUERY PLAN for the queries behind the calendar, the patient
+// JOIN and the treatment history so index usage can be checked by hand.
+void explainHotQueries(QSqlDatabase &db);
+
+// --- Medications ---
+// Treatments.medications keeps the list as "a;b;c" for display and search;
+// TreatmentMedications holds one row per entry for indexed lookups. Both
+// helpers run in a single pass; split accepts a trailing ';' and trims entries.
+std::vector<std::string> splitMedications(const std::string &text);
+
+// Same rules on Qt strings, so rows read from the database stay QString.
+QStringList splitMedications(QStringView text);
+
+QString joinMedications(const std::vector<std::string> &meds);
+
+// --- Change events ---
+// Repositories report every row they write. Changes are buffered per
+// connection while a transaction or savepoint is open, published when it
+// commits and dropped when it rolls back, so views only ever see committed
+// rows and can apply them as deltas instead of reloading.
+enum class ClinicTable { Patients, Appointments, Treatments };
+
+enum class ChangeOp { Insert, Update, Delete, BulkInsert };
+
+struct RowChange {
+    ClinicTable table;
+    ChangeOp op;
+    int id;             // row id; 0 for treatment updates/deletes, which match by appointment
+    int patientId;      // the patient itself, or the owner of an appointment/treatment
+    int appointmentId;  // treatments only
+    QString date;       // appointments only: yyyy-MM-dd after the change, empty on delete
+    QString label;      // patient name or treatment notes, empty on delete
+    QString contact;    // patients only, empty on delete
+};
+
+// Delivers committed changes to subscribers on their own threads. Handlers get
+// one batch per commit, in commit order.
+class ChangeBus {
+public:
+    using Handler = std::function<void(const std::vector<RowChange> &)>;
+
+    static ChangeBus &instance() {
+        static ChangeBus bus;
+        return bus;
+    }
+
+    void subscribe(QObject *receiver, Handler handler) {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscribers.push_back(Subscriber{receiver, std::move(handler)});
+        active.store(true);
+    }
+
+    // Without subscribers (headless commands, benchmarks) nothing is buffered.
+    bool hasSubscribers() const { return active.load(); }
+
+    void publish(const std::vector<RowChange> &changes) {
+        if (changes.empty()) return;
+        std::vector<Subscriber> targets;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            targets = subscribers;
+        }
+        for (const Subscriber &s : targets) {
+            if (!s.receiver) continue;
+            Handler handler = s.handler;
+            QMetaObject::invokeMethod(s.receiver.data(), [handler, changes]() { handler(changes); },
+                                      Qt::QueuedConnection);
+        }
+    }
+
+private:
+    struct Subscriber {
+        QPointer<QObject> receiver;
+        Handler handler;
+    };
+
+    std::mutex mutex;
+    std::vector<Subscriber> subscribers;
+    std::atomic<bool> active{false};
+};
+
+// The changes made on one connection, held back while a transaction or
+// savepoint is open.
+class ChangeLog {
+public:
+    // Above this many inserts into one table in a single commit, subscribers
+    // get one BulkInsert instead of a row-by-row list.
+    static constexpr int kBulkThreshold = 5000;
+
+    void add(RowChange change) {
+        if (!ChangeBus::instance().hasSubscribers()) return;
+        pending.push_back(std::move(change));
+        if (depth == 0) flush();
+    }
+
+    // Opens a nesting level and returns the mark to roll back to.
+    size_t begin() {
+        ++depth;
+        return pending.size();
+    }
+
+    void commit() {
+        if (depth > 0 && --depth == 0) flush();
+    }
+
+    void rollback(size_t mark) {
+        if (mark < pending.size()) pending.resize(mark);
+        if (depth > 0) --depth;
+    }
+
+private:
+    void flush() {
+        int inserts[3] = {0, 0, 0};
+        for (const RowChange &c : pending)
+            if (c.op == ChangeOp::Insert) ++inserts[static_cast<int>(c.table)];
+
+        std::vector<RowChange> batch;
+        bool collapsed[3] = {false, false, false};
+        for (RowChange &c : pending) {
+            int t = static_cast<int>(c.table);
+            if (c.op != ChangeOp::Insert || inserts[t] <= kBulkThreshold) {
+                batch.push_back(std::move(c));
+            } else if (!collapsed[t]) {
+                collapsed[t] = true;
+                batch.push_back(RowChange{c.table, ChangeOp::BulkInsert, 0, 0, 0, QString(), QString(), QString()});
+            }
+        }
+        pending.clear();
+        ChangeBus::instance().publish(batch);
+    }
+
+    std::vector<RowChange> pending;
+    int depth = 0;
+};
+
+// --- Repositories ---
+// One repository per table and connection. Each keeps its prepared statements
+// alive between calls and only rebinds values, so SQLite compiles every
+// statement once per connection instead of once per call.
+struct StatementCacheStats {
+    std::atomic<quint64> hits{0};
+    std::atomic<quint64> misses{0};
+};
+
+StatementCacheStats &statementCacheStats();
+
+class Repository {
+public:
+    Repository(const QSqlDatabase &db, ChangeLog &changes) : db(db), changes(changes) {}
+
+protected:
+    // Returns the statement registered under key, preparing it on first use.
+    QSqlQuery *statement(const char *key, const char *sql) {
+        auto it = statements.find(key);
+        if (it != statements.end()) {
+            ++statementCacheStats().hits;
+            return &it->second;
+        }
+        ++statementCacheStats().misses;
+
+        QSqlQuery query(db);
+        if (!query.prepare(sql)) {
+            writeLog(QString("Failed to prepare %1: ").arg(key) + query.lastError().text(), LogLevel::Error);
+            return nullptr;
+        }
+        QSqlQuery *prepared = &statements.emplace(key, query).first->second;
+        statementKeys.emplace(prepared, key);
+        return prepared;
+    }
+
+    // Executes a statement returned by statement(), recording its latency.
+    bool exec(QSqlQuery *query) {
+        auto it = statementKeys.find(query);
+        return execTimed(*query, it != statementKeys.end() ? QString(it->second) : QString("unknown"));
+    }
+
+    // Runs fn inside a savepoint so multi-statement writes are atomic whether or
+    // not the caller already has a transaction open. The SAVEPOINT, RELEASE and
+    // ROLLBACK TO statements are prepared once per name, like the others, since
+    // bulk imports open one per row.
+    template <typename Fn>
+    bool inSavepoint(const char *name, Fn fn) {
+        Savepoint *sp = savepoint(name);
+        if (!sp || !execTimed(sp->open, "savepoint")) {
+            writeLog("Failed to open savepoint: " + (sp ? sp->open.lastError().text() : QString(name)), LogLevel::Error);
+            return false;
+        }
+        size_t mark = changes.begin();
+        if (fn()) {
+            execTimed(sp->release, "savepoint");
+            changes.commit();
+            return true;
+        }
+        execTimed(sp->rollback, "savepoint");
+        execTimed(sp->release, "savepoint");
+        changes.rollback(mark);
+        return false;
+    }
+
+    // Runs fn once per row inside a single transaction.
+    template <typename Row, typename Fn>
+    int inTransaction(const std::vector<Row> &rows, Fn fn) {
+        if (!db.transaction()) {
+            writeLog("Failed to begin transaction: " + db.lastError().text(), LogLevel::Error);
+            return 0;
+        }
+        size_t mark = changes.begin();
+        int inserted = 0;
+        for (const Row &row : rows) {
+            if (!fn(row)) {
+                db.rollback();
+                changes.rollback(mark);
+                return 0;
+            }
+            ++inserted;
+        }
+        if (!db.commit()) {
+            writeLog("Failed to commit transaction: " + db.lastError().text(), LogLevel::Error);
+            db.rollback();
+            changes.rollback(mark);
+            return 0;
+        }
+        changes.commit();
+        return inserted;
+    }
+
+    void changed(ClinicTable table, ChangeOp op, int id, int patientId = 0, int appointmentId = 0,
+                 const QString &date = QString(), const QString &label = QString(),
+                 const QString &contact = QString()) {
+        changes.add(RowChange{table, op, id, patientId, appointmentId, date, label, contact});
+    }
+
+    QSqlDatabase db;
+    ChangeLog &changes;
+
+private:
+    struct Savepoint {
+        QSqlQuery open;
+        QSqlQuery release;
+        QSqlQuery rollback;
+    };
+
+    Savepoint *savepoint(const char *name) {
+        auto it = savepoints.find(name);
+        if (it != savepoints.end()) {
+            ++statementCacheStats().hits;
+            return &it->second;
+        }
+        ++statementCacheStats().misses;
+        Savepoint sp{QSqlQuery(db), QSqlQuery(db), QSqlQuery(db)};
+        if (!sp.open.prepare(QString("SAVEPOINT %1").arg(name)) ||
+            !sp.release.prepare(QString("RELEASE %1").arg(name)) ||
+            !sp.rollback.prepare(QString("ROLLBACK TO %1").arg(name))) {
+            writeLog(QString("Failed to prepare savepoint %1: ").arg(name) + sp.open.lastError().text(), LogLevel::Error);
+            return nullptr;
+        }
+        return &savepoints.emplace(name, sp).first->second;
+    }
+
+    std::unordered_map<std::string, QSqlQuery> statements;
+    std::unordered_map<const QSqlQuery *, const char *> statementKeys;
+    std::unordered_map<std::string, Savepoint> savepoints;
+};
+
+class PatientRepository : public Repository {
+public:
+    using Repository::Repository;
+
+    bool insert(const Patient &p, int *newId = nullptr) {
+        QSqlQuery *query = statement("patients.insert",
+            "INSERT INTO Patients (name, age, contact, medicalHistory) VALUES (?, ?, ?, ?)");
+        if (!query) return false;
+        query->bindValue(0, QString::fromStdString(p.name));
+        query->bindValue(1, p.age);
+        query->bindValue(2, QString::fromStdString(p.contact));
+        query->bindValue(3, QString::fromStdString(p.medicalHistory));
+
+        if (!exec(query)) {
+            writeLog("Failed to add patient:" + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        int id = query->lastInsertId().toInt();
+        changed(ClinicTable::Patients, ChangeOp::Insert, id, id, 0, QString(), QString::fromStdString(p.name),
+                QString::fromStdString(p.contact));
+        if (newId) *newId = id;
+        return true;
+    }
+
+    // Import variant: keeps p.id when it is set so references from other
+    // imported tables stay valid, and reports errors instead of logging them.
+    bool insertWithId(const Patient &p, QString *error) {
+        QSqlQuery *query = statement("patients.insertWithId",
+            "INSERT INTO Patients (id, name, age, contact, medicalHistory) VALUES (?, ?, ?, ?, ?)");
+        if (!query) return false;
+        query->bindValue(0, p.id > 0 ? QVariant(p.id) : QVariant());
+        query->bindValue(1, QString::fromStdString(p.name));
+        query->bindValue(2, p.age);
+        query->bindValue(3, QString::fromStdString(p.contact));
+        query->bindValue(4, QString::fromStdString(p.medicalHistory));
+        if (!exec(query)) {
+            if (error) *error = query->lastError().text();
+            return false;
+        }
+        int id = query->lastInsertId().toInt();
+        changed(ClinicTable::Patients, ChangeOp::Insert, id, id, 0, QString(), QString::fromStdString(p.name),
+                QString::fromStdString(p.contact));
+        return true;
+    }
+
+    int insertBatch(const std::vector<Patient> &patients) {
+        return inTransaction(patients, [this](const Patient &p) { return insert(p); });
+    }
+
+    bool update(const Patient &p) {
+        QSqlQuery *query = statement("patients.update",
+            "UPDATE Patients SET name=?, age=?, contact=?, medicalHistory=? WHERE id=?");
+        if (!query) return false;
+        query->bindValue(0, QString::fromStdString(p.name));
+        query->bindValue(1, p.age);
+        query->bindValue(2, QString::fromStdString(p.contact));
+        query->bindValue(3, QString::fromStdString(p.medicalHistory));
+        query->bindValue(4, p.id);
+
+        if (!exec(query)) {
+            writeLog("Failed to edit patient: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        // Nothing to publish when the row is already gone.
+        if (query->numRowsAffected() == 0) {
+            writeLog(QString("No patient with id %1 to edit").arg(p.id), LogLevel::Warning);
+            return false;
+        }
+        changed(ClinicTable::Patients, ChangeOp::Update, p.id, p.id, 0, QString(), QString::fromStdString(p.name),
+                QString::fromStdString(p.contact));
+        return true;
+    }
+
+    bool remove(int patientId) {
+        QSqlQuery *query = statement("patients.delete", "DELETE FROM Patients WHERE id=?");
+        if (!query) return false;
+        query->bindValue(0, patientId);
+        if (!exec(query)) {
+            writeLog("Failed to delete patient: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        if (query->numRowsAffected() == 0) {
+            writeLog(QString("No patient with id %1 to delete").arg(patientId), LogLevel::Warning);
+            return false;
+        }
+        changed(ClinicTable::Patients, ChangeOp::Delete, patientId, patientId);
+        return true;
+    }
+
+    std::vector<PatientSummary> page(int afterId, int limit) {
+        std::vector<PatientSummary> patients;
+        QSqlQuery *query = statement("patients.page",
+            "SELECT id, name FROM Patients WHERE id > ? ORDER BY id LIMIT ?");
+        if (!query) return patients;
+        query->bindValue(0, afterId);
+        query->bindValue(1, limit);
+        if (!exec(query)) {
+            writeLog("Failed to fetch patient page: " + query->lastError().text(), LogLevel::Error);
+            return patients;
+        }
+
+        patients.reserve(limit);
+        while (query->next())
+            patients.push_back(PatientSummary{query->value(0).toInt(), query->value(1).toString()});
+        query->finish();
+        return patients;
+    }
+
+    Patient byId(int patientId) {
+        Patient p{0, std::string(), 0, std::string(), std::string()};
+        QSqlQuery *query = statement("patients.byId",
+            "SELECT id, name, age, contact, medicalHistory FROM Patients WHERE id=?");
+        if (!query) return p;
+        query->bindValue(0, patientId);
+        if (exec(query) && query->next()) {
+            p = Patient{
+                query->value(0).toInt(),
+                query->value(1).toString().toStdString(),
+                query->value(2).toInt(),
+                query->value(3).toString().toStdString(),
+                query->value(4).toString().toStdString()
+            };
+        }
+        query->finish();
+        return p;
+    }
+
+    std::vector<Patient> all() {
+        std::vector<Patient> patients;
+        QSqlQuery *query = statement("patients.all", "SELECT id, name, age, contact, medicalHistory FROM Patients");
+        if (!query || !exec(query)) return patients;
+
+        while (query->next()) {
+            patients.push_back(Patient{
+                query->value(0).toInt(),
+                query->value(1).toString().toStdString(),
+                query->value(2).toInt(),
+                query->value(3).toString().toStdString(),
+                query->value(4).toString().toStdString()
+            });
+        }
+        query->finish();
+        return patients;
+    }
+};
+
+// One line of the calendar view: an appointment joined with its patient's name.
+struct DayAppointment {
+    int id;
+    QString time;
+    int patientId;
+    QString patientName;
+    QString purpose;
+    QString date;
+    bool completed;
+    int durationMinutes = 30;
+};
+
+// An appointment as the scheduler sees it: minutes since midnight, end exclusive.
+struct Booking {
+    int id;
+    int patientId;
+    int start;
+    int end;
+};
+
+class AppointmentRepository : public Repository {
+public:
+    using Repository::Repository;
+
+    bool insert(const Appointment &a, int *newId = nullptr) {
+        QSqlQuery *query = statement("appointments.insert",
+            "INSERT INTO Appointments (patientId, date, time, purpose, completed, duration) VALUES (?, ?, ?, ?, ?, ?)");
+        if (!query) return false;
+        query->bindValue(0, a.patientId);
+        query->bindValue(1, QString::fromStdString(a.date));
+        query->bindValue(2, QString::fromStdString(a.time));
+        query->bindValue(3, QString::fromStdString(a.purpose));
+        query->bindValue(4, a.completed ? 1 : 0);
+        query->bindValue(5, a.durationMinutes);
+
+        if (!exec(query)) {
+            writeLog("Failed to add appointment:" + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        int id = query->lastInsertId().toInt();
+        changed(ClinicTable::Appointments, ChangeOp::Insert, id, a.patientId, 0, QString::fromStdString(a.date));
+        if (newId) *newId = id;
+        return true;
+    }
+
+    bool insertWithId(const Appointment &a, QString *error) {
+        QSqlQuery *query = statement("appointments.insertWithId",
+            "INSERT INTO Appointments (id, patientId, date, time, purpose, completed, duration) VALUES (?, ?, ?, ?, ?, ?, ?)");
+        if (!query) return false;
+        query->bindValue(0, a.id > 0 ? QVariant(a.id) : QVariant());
+        query->bindValue(1, a.patientId);
+        query->bindValue(2, QString::fromStdString(a.date));
+        query->bindValue(3, QString::fromStdString(a.time));
+        query->bindValue(4, QString::fromStdString(a.purpose));
+        query->bindValue(5, a.completed ? 1 : 0);
+        query->bindValue(6, a.durationMinutes);
+        if (!exec(query)) {
+            if (error) *error = query->lastError().text();
+            return false;
+        }
+        changed(ClinicTable::Appointments, ChangeOp::Insert, query->lastInsertId().toInt(), a.patientId, 0,
+                QString::fromStdString(a.date));
+        return true;
+    }
+
+    int insertBatch(const std::vector<Appointment> &appointments) {
+        return inTransaction(appointments, [this](const Appointment &a) { return insert(a); });
+    }
+
+    bool update(const Appointment &a) {
+        QSqlQuery *query = statement("appointments.update",
+            "UPDATE Appointments SET patientId=?, date=?, time=?, purpose=?, completed=?, duration=? WHERE id=?");
+        if (!query) return false;
+        query->bindValue(0, a.patientId);
+        query->bindValue(1, QString::fromStdString(a.date));
+        query->bindValue(2, QString::fromStdString(a.time));
+        query->bindValue(3, QString::fromStdString(a.purpose));
+        query->bindValue(4, a.completed ? 1 : 0);
+        query->bindValue(5, a.durationMinutes);
+        query->bindValue(6, a.id);
+
+        if (!exec(query)) {
+            writeLog("Failed to edit appointment: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        if (query->numRowsAffected() == 0) {
+            writeLog(QString("No appointment with id %1 to edit").arg(a.id), LogLevel::Warning);
+            return false;
+        }
+        changed(ClinicTable::Appointments, ChangeOp::Update, a.id, a.patientId, 0, QString::fromStdString(a.date));
+        return true;
+    }
+
+    bool remove(int appointmentId) {
+        QSqlQuery *query = statement("appointments.delete", "DELETE FROM Appointments WHERE id=?");
+        if (!query) return false;
+        query->bindValue(0, appointmentId);
+        if (!exec(query)) {
+            writeLog("Failed to delete appointment: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        if (query->numRowsAffected() == 0) {
+            writeLog(QString("No appointment with id %1 to delete").arg(appointmentId), LogLevel::Warning);
+            return false;
+        }
+        changed(ClinicTable::Appointments, ChangeOp::Delete, appointmentId);
+        return true;
+    }
+
+    std::vector<DayAppointment> byDate(const QString &date) {
+        std::vector<DayAppointment> appointments;
+        QSqlQuery *query = statement("appointments.byDate",
+            "SELECT a.id, a.time, a.patientId, p.name, a.purpose, a.date, a.completed, a.duration "
+            "FROM Appointments a "
+            "JOIN Patients p ON a.patientId = p.id "
+            "WHERE a.date = ? ORDER BY a.time");
+        if (!query) return appointments;
+        query->bindValue(0, date);
+        return readDayAppointments(query);
+    }
+
+    // Appointments from `from` to `to` inclusive (yyyy-MM-dd), ordered by date and time.
+    std::vector<DayAppointment> inRange(const QString &from, const QString &to) {
+        QSqlQuery *query = statement("appointments.inRange",
+            "SELECT a.id, a.time, a.patientId, p.name, a.purpose, a.date, a.completed, a.duration "
+            "FROM Appointments a "
+            "JOIN Patients p ON a.patientId = p.id "
+            "WHERE a.date BETWEEN ? AND ? ORDER BY a.date, a.time");
+        if (!query) return std::vector<DayAppointment>();
+        query->bindValue(0, from);
+        query->bindValue(1, to);
+        return readDayAppointments(query);
+    }
+
+    // Bookings from `from` to `to` inclusive, grouped by day, for the scheduler.
+    std::map<QDate, std::vector<Booking>> bookings(const QDate &from, const QDate &to) {
+        std::map<QDate, std::vector<Booking>> days;
+        QSqlQuery *query = statement("appointments.bookings",
+            "SELECT id, patientId, date, time, duration FROM Appointments WHERE date BETWEEN ? AND ?");
+        if (!query) return days;
+        query->bindValue(0, from.toString("yyyy-MM-dd"));
+        query->bindValue(1, to.toString("yyyy-MM-dd"));
+        if (!exec(query)) {
+            writeLog("Failed to fetch bookings: " + query->lastError().text(), LogLevel::Error);
+            return days;
+        }
+        while (query->next()) {
+            QTime time = QTime::fromString(query->value(3).toString(), "HH:mm");
+            if (!time.isValid()) continue;
+            int start = time.hour() * 60 + time.minute();
+            days[QDate::fromString(query->value(2).toString(), "yyyy-MM-dd")].push_back(Booking{
+                query->value(0).toInt(),
+                query->value(1).toInt(),
+                start,
+                start + std::max(1, query->value(4).toInt())
+            });
+        }
+        query->finish();
+        return days;
+    }
+
+    // True when the stored row already has a's patient, date, time and duration,
+    // i.e. an update that only touches purpose or completion.
+    bool sameSlot(const Appointment &a) {
+        QSqlQuery *query = statement("appointments.sameSlot",
+            "SELECT 1 FROM Appointments WHERE id=? AND patientId=? AND date=? AND time=? AND duration=?");
+        if (!query) return false;
+        query->bindValue(0, a.id);
+        query->bindValue(1, a.patientId);
+        query->bindValue(2, QString::fromStdString(a.date));
+        query->bindValue(3, QString::fromStdString(a.time));
+        query->bindValue(4, a.durationMinutes);
+        if (!exec(query)) {
+            writeLog("Failed to read appointment: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        bool same = query->next();
+        query->finish();
+        return same;
+    }
+
+private:
+    std::vector<DayAppointment> readDayAppointments(QSqlQuery *query) {
+        std::vector<DayAppointment> appointments;
+        if (!exec(query)) {
+            writeLog("Failed to fetch appointments: " + query->lastError().text(), LogLevel::Error);
+            return appointments;
+        }
+
+        while (query->next()) {
+            appointments.push_back(DayAppointment{
+                query->value(0).toInt(),
+                query->value(1).toString(),
+                query->value(2).toInt(),
+                query->value(3).toString(),
+                query->value(4).toString(),
+                query->value(5).toString(),
+                query->value(6).toInt() != 0,
+                query->value(7).toInt()
+            });
+        }
+        query->finish();
+        return appointments;
+    }
+};
+
+// How often a medication has been prescribed, from TreatmentMedications.
+struct MedicationCount {
+    QString name;
+    int prescriptions;
+};
+
+class TreatmentRepository : public Repository {
+public:
+    using Repository::Repository;
+
+    bool insert(const Treatment &t, int *newId = nullptr) {
+        int id = 0;
+        bool ok = inSavepoint("treatment_insert", [&]() {
+            QSqlQuery *query = statement("treatments.insert",
+                "INSERT INTO Treatments (patientId, appointmentId, notes, medications) VALUES (?, ?, ?, ?)");
+            if (!query) return false;
+            query->bindValue(0, t.patientId);
+            query->bindValue(1, t.appointmentId);
+            query->bindValue(2, QString::fromStdString(t.notes));
+            query->bindValue(3, joinMedications(t.medications));
+
+            if (!exec(query)) {
+                writeLog("Failed to add treatment:" + query->lastError().text(), LogLevel::Error);
+                return false;
+            }
+            id = query->lastInsertId().toInt();
+            changed(ClinicTable::Treatments, ChangeOp::Insert, id, t.patientId, t.appointmentId, QString(),
+                    QString::fromStdString(t.notes));
+            return insertMedications(id, t.medications);
+        });
+        if (ok && newId) *newId = id;
+        return ok;
+    }
+
+    bool insertWithId(const Treatment &t, QString *error) {
+        return inSavepoint("treatment_import", [&]() {
+            QSqlQuery *query = statement("treatments.insertWithId",
+                "INSERT INTO Treatments (id, patientId, appointmentId, notes, medications) VALUES (?, ?, ?, ?, ?)");
+            if (!query) return false;
+            query->bindValue(0, t.id > 0 ? QVariant(t.id) : QVariant());
+            query->bindValue(1, t.patientId);
+            query->bindValue(2, t.appointmentId);
+            query->bindValue(3, QString::fromStdString(t.notes));
+            query->bindValue(4, joinMedications(t.medications));
+            if (!exec(query)) {
+                if (error) *error = query->lastError().text();
+                return false;
+            }
+            int id = query->lastInsertId().toInt();
+            changed(ClinicTable::Treatments, ChangeOp::Insert, id, t.patientId, t.appointmentId, QString(),
+                    QString::fromStdString(t.notes));
+            return insertMedications(id, t.medications);
+        });
+    }
+
+    int insertBatch(const std::vector<Treatment> &treatments) {
+        return inTransaction(treatments, [this](const Treatment &t) { return insert(t); });
+    }
+
+    bool update(const Treatment &t) {
+        return inSavepoint("treatment_update", [&]() {
+            QSqlQuery *query = statement("treatments.update",
+                "UPDATE Treatments SET notes=?, medications=? WHERE patientId=? AND appointmentId=?");
+            if (!query) return false;
+            query->bindValue(0, QString::fromStdString(t.notes));
+            query->bindValue(1, joinMedications(t.medications));
+            query->bindValue(2, t.patientId);
+            query->bindValue(3, t.appointmentId);
+
+            if (!exec(query)) {
+                writeLog("Failed to edit treatment: " + query->lastError().text(), LogLevel::Error);
+                return false;
+            }
+            if (query->numRowsAffected() == 0) {
+                writeLog(QString("No treatment for patient %1, appointment %2 to edit")
+                         .arg(t.patientId).arg(t.appointmentId), LogLevel::Warning);
+                return false;
+            }
+
+            QSqlQuery *clear = statement("treatmentMedications.clearForAppointment",
+                "DELETE FROM TreatmentMedications WHERE treatmentId IN "
+                "(SELECT id FROM Treatments WHERE patientId=? AND appointmentId=?)");
+            QSqlQuery *add = statement("treatmentMedications.insertForAppointment",
+                "INSERT INTO TreatmentMedications (treatmentId, name) "
+                "SELECT id, ? FROM Treatments WHERE patientId=? AND appointmentId=?");
+            if (!clear || !add) return false;
+            clear->bindValue(0, t.patientId);
+            clear->bindValue(1, t.appointmentId);
+            if (!exec(clear)) {
+                writeLog("Failed to clear treatment medications: " + clear->lastError().text(), LogLevel::Error);
+                return false;
+            }
+            for (const auto &m : t.medications) {
+                add->bindValue(0, QString::fromStdString(m));
+                add->bindValue(1, t.patientId);
+                add->bindValue(2, t.appointmentId);
+                if (!exec(add)) {
+                    writeLog("Failed to add treatment medication: " + add->lastError().text(), LogLevel::Error);
+                    return false;
+                }
+            }
+            changed(ClinicTable::Treatments, ChangeOp::Update, 0, t.patientId, t.appointmentId, QString(),
+                    QString::fromStdString(t.notes));
+            return true;
+        });
+    }
+
+    // TreatmentMedications rows are removed by the treatment_medications_delete trigger.
+    bool remove(int patientId, int appointmentId) {
+        QSqlQuery *query = statement("treatments.delete",
+            "DELETE FROM Treatments WHERE patientId=? AND appointmentId=?");
+        if (!query) return false;
+        query->bindValue(0, patientId);
+        query->bindValue(1, appointmentId);
+
+        if (!exec(query)) {
+            writeLog("Failed to delete treatment: " + query->lastError().text(), LogLevel::Error);
+            return false;
+        }
+        if (query->numRowsAffected() == 0) {
+            writeLog(QString("No treatment for patient %1, appointment %2 to delete")
+                     .arg(patientId).arg(appointmentId), LogLevel::Warning);
+            return false;
+        }
+        changed(ClinicTable::Treatments, ChangeOp::Delete, 0, patientId, appointmentId);
+        return true;
+    }
+
+    std::vector<TreatmentRow> historyByPatient(int patientId) {
+        std::vector<TreatmentRow> rows;
+        QSqlQuery *query = statement("treatments.byPatient",
+            "SELECT id, patientId, appointmentId, notes, medications FROM Treatments WHERE patientId=?");
+        if (!query) return rows;
+        query->bindValue(0, patientId);
+        if (!exec(query)) {
+            writeLog("Failed to fetch treatment history: " + query->lastError().text(), LogLevel::Error);
+            return rows;
+        }
+        while (query->next()) {
+            rows.push_back(TreatmentRow{
+                query->value(0).toInt(),
+                query->value(1).toInt(),
+                query->value(2).toInt(),
+                query->value(3).toString(),
+                splitMedications(query->value(4).toString())
+            });
+        }
+        query->finish();
+        return rows;
+    }
+
+    std::vector<Treatment> byPatient(int patientId) {
+        std::vector<Treatment> treatments;
+        QSqlQuery *query = statement("treatments.byPatient",
+            "SELECT id, patientId, appointmentId, notes, medications FROM Treatments WHERE patientId=?");
+        if (!query) return treatments;
+        query->bindValue(0, patientId);
+        if (!exec(query)) return treatments;
+
+        while (query->next()) {
+            treatments.push_back(Treatment{
+                query->value(0).toInt(),
+                query->value(1).toInt(),
+                query->value(2).toInt(),
+                query->value(3).toString().toStdString(),
+                splitMedications(query->value(4).toString().toStdString())
+            });
+        }
+        query->finish();
+        return treatments;
+    }
+
+    std::vector<PatientSummary> patientsOnMedication(const QString &name) {
+        std::vector<PatientSummary> patients;
+        QSqlQuery *query = statement("treatmentMedications.patients",
+            "SELECT DISTINCT p.id, p.name FROM TreatmentMedications m "
+            "JOIN Treatments t ON t.id = m.treatmentId "
+            "JOIN Patients p ON p.id = t.patientId "
+            "WHERE m.name = ? ORDER BY p.id");
+        if (!query) return patients;
+        query->bindValue(0, name.trimmed());
+        if (!exec(query)) {
+            writeLog("Failed to fetch patients on medication: " + query->lastError().text(), LogLevel::Error);
+            return patients;
+        }
+        while (query->next())
+            patients.push_back(PatientSummary{query->value(0).toInt(), query->value(1).toString()});
+        query->finish();
+        return patients;
+    }
+
+    std::vector<MedicationCount> topMedications(int limit) {
+        std::vector<MedicationCount> counts;
+        QSqlQuery *query = statement("treatmentMedications.top",
+            "SELECT name, COUNT(*) AS prescriptions FROM TreatmentMedications "
+            "GROUP BY name ORDER BY prescriptions DESC, name LIMIT ?");
+        if (!query) return counts;
+        query->bindValue(0, limit);
+        if (!exec(query)) {
+            writeLog("Failed to fetch top medications: " + query->lastError().text(), LogLevel::Error);
+            return counts;
+        }
+        while (query->next())
+            counts.push_back(MedicationCount{query->value(0).toString(), query->value(1).toInt()});
+        query->finish();
+        return counts;
+    }
+
+private:
+    bool insertMedications(int treatmentId, const std::vector<std::string> &medications) {
+        if (medications.empty()) return true;
+        QSqlQuery *query = statement("treatmentMedications.insert",
+            "INSERT INTO TreatmentMedications (treatmentId, name) VALUES (?, ?)");
+        if (!query) return false;
+        for (const auto &m : medications) {
+            query->bindValue(0, treatmentId);
+            query->bindValue(1, QString::fromStdString(m));
+            if (!exec(query)) {
+                writeLog("Failed to add treatment medication: " + query->lastError().text(), LogLevel::Error);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct Repositories {
+    explicit Repositories(const QSqlDatabase &db)
+        : patients(db, changes), appointments(db, changes), treatments(db, changes) {}
+
+    ChangeLog changes;
+    PatientRepository patients;
+    AppointmentRepository appointments;
+    TreatmentRepository treatments;
+};
+
+// Repositories are created per connection on first use. Call
+// releaseRepositories() before closing a connection so no prepared
+// statement outlives it.
+std::unordered_map<std::string, std::unique_ptr<Repositories>> &repositoryRegistry();
+
+Repositories &repositoriesFor(QSqlDatabase &db);
+
+void releaseRepositories(QSqlDatabase &db);
+
+bool addPatient(QSqlDatabase &db, const Patient &p, int *newId = nullptr);
+
+std::vector<Patient> getAllPatients(QSqlDatabase &db);
+
+std::vector<PatientSummary> getPatientPage(QSqlDatabase &db, int afterId, int limit);
+
+// Returns a Patient with id 0 when no row matches.
+Patient getPatientById(QSqlDatabase &db, int patientId);
+
+bool updatePatient(QSqlDatabase &db, const Patient &p);
+
+bool deletePatient(QSqlDatabase &db, int patientId);
+
+bool addTreatment(QSqlDatabase &db, const Treatment &t);
+
+std::vector<Treatment> getTreatmentsByPatient(QSqlDatabase &db, int patientId);
+
+std::vector<TreatmentRow> getTreatmentHistory(QSqlDatabase &db, int patientId);
+
+std::vector<PatientSummary> getPatientsOnMedication(QSqlDatabase &db, const QString &medication);
+
+std::vector<MedicationCount> getTopMedications(QSqlDatabase &db, int limit);
+
+bool updateTreatment(QSqlDatabase &db, const Treatment &t);
+
+bool deleteTreatment(QSqlDatabase &db, int patientId, int appointmentId);
+
+bool addAppointment(QSqlDatabase &db, const Appointment &a);
+
+bool updateAppointment(QSqlDatabase &db, const Appointment &a);
+
+bool deleteAppointment(QSqlDatabase &db, int appointmentId);
+
+std::vector<DayAppointment> getAppointmentsByDate(QSqlDatabase &db, const QString &date);
+
+std::vector<DayAppointment> getAppointmentsInRange(QSqlDatabase &db, const QString &from, const QString &to);
+
+// --- Scheduling ---
+// Conflict checks and free-slot search. Each day's bookings are indexed in a
+// segment tree over 5-minute slots holding how many bookings cover each slot,
+// plus per-patient interval lists, so an overlap check is O(log n) once the
+// day is built. A slot is taken when every practitioner is busy in it or the
+// patient already has an appointment then.
+struct ScheduleRules {
+    int opensMinute;     // first bookable minute of the day
+    int closesMinute;    // appointments must end by this minute
+    int practitioners;   // bookings allowed at the same time
+    int stepMinutes;     // granularity of suggested start times
+};
+
+ScheduleRules loadScheduleRules();
+
+class DaySchedule {
+public:
+    static constexpr int kSlotMinutes = 5;
+    static constexpr int kSlots = 24 * 60 / kSlotMinutes;
+
+    // Indexes every booking except excludeId (the appointment being edited).
+    DaySchedule(const std::vector<Booking> &bookings, int excludeId = 0) {
+        for (const Booking &b : bookings) {
+            if (b.id == excludeId) continue;
+            int from = std::max(0, b.start / kSlotMinutes);
+            int to = std::min(kSlots, (b.end + kSlotMinutes - 1) / kSlotMinutes);
+            if (from < to) add(1, 0, kSlots, from, to);
+            patients[b.patientId].push_back(Interval{b.start, b.end, 0});
+        }
+        for (auto &entry : patients) {
+            std::vector<Interval> &list = entry.second;
+            std::sort(list.begin(), list.end(), [](const Interval &a, const Interval &b) { return a.start < b.start; });
+            int maxEnd = 0;
+            for (Interval &i : list) i.maxEnd = maxEnd = std::max(maxEnd, i.end);
+        }
+    }
+
+    // Highest number of bookings covering any slot of [start, end).
+    int peak(int start, int end) const {
+        int from = std::max(0, start / kSlotMinutes);
+        int to = std::min(kSlots, (end + kSlotMinutes - 1) / kSlotMinutes);
+        return from < to ? query(1, 0, kSlots, from, to) : 0;
+    }
+
+    bool patientBusy(int patientId, int start, int end) const {
+        auto it = patients.find(patientId);
+        if (it == patients.end()) return false;
+        const std::vector<Interval> &list = it->second;
+        // Last interval starting before `end`; it overlaps if any interval up
+        // to it ends after `start`.
+        auto pos = std::lower_bound(list.begin(), list.end(), end,
+                                    [](const Interval &i, int value) { return i.start < value; });
+        return pos != list.begin() && std::prev(pos)->maxEnd > start;
+    }
+
+private:
+    struct Interval {
+        int start;
+        int end;
+        int maxEnd;   // largest end among this and earlier intervals
+    };
+
+    // Range add without push-down: a node's value is its own pending add plus
+    // the max of its children.
+    void add(int node, int lo, int hi, int from, int to) {
+        if (to <= lo || hi <= from) return;
+        if (from <= lo && hi <= to) {
+            ++tree[node];
+            ++pending[node];
+            return;
+        }
+        int mid = (lo + hi) / 2;
+        add(2 * node, lo, mid, from, to);
+        add(2 * node + 1, mid, hi, from, to);
+        tree[node] = pending[node] + std::max(tree[2 * node], tree[2 * node + 1]);
+    }
+
+    int query(int node, int lo, int hi, int from, int to) const {
+        if (to <= lo || hi <= from) return 0;
+        if (from <= lo && hi <= to) return tree[node];
+        int mid = (lo + hi) / 2;
+        return pending[node] + std::max(query(2 * node, lo, mid, from, to),
+                                        query(2 * node + 1, mid, hi, from, to));
+    }
+
+    std::array<int, 4 * kSlots> tree{};
+    std::array<int, 4 * kSlots> pending{};
+    std::unordered_map<int, std::vector<Interval>> patients;
+};
+
+struct SlotCheck {
+    bool free;
+    QString reason;
+};
+
+SlotCheck checkSlot(const DaySchedule &day, const ScheduleRules &rules, int patientId, int start, int duration);
+
+// Checks a.date/a.time/a.durationMinutes against the other appointments of that day.
+SlotCheck checkAppointmentSlot(QSqlDatabase &db, const Appointment &a, const ScheduleRules &rules);
+
+// Inserts (id 0) or updates the appointment if its slot is free. The check and
+// the write share a BEGIN IMMEDIATE transaction, which takes the write lock
+// before reading, so two desks cannot book the same slot. Updates that keep the
+// patient, date, time and duration skip the check.
+bool bookAppointment(QSqlDatabase &db, const Appointment &a, QString *conflict);
+
+struct FreeSlot {
+    QDate date;
+    QTime start;
+};
+
+// The first `count` free starts of `duration` minutes from `from` to `to`,
+// earliest first. Starts before notBefore are skipped; patientId > 0 also
+// avoids that patient's own appointments.
+std::vector<FreeSlot> findFreeSlots(QSqlDatabase &db, const QDate &from, const QDate &to, int duration, int count,
+                                    const ScheduleRules &rules, int patientId = 0,
+                                    const QDateTime &notBefore = QDateTime());
+
+// --- Full-text search ---
+struct SearchHit {
+    int patientId;
+    QString patientName;
+    QString snippet;   // matched terms wrapped in [ ]
+    double rank;       // weighted bm25, lower is better
+};
+
+// Hits from both tables are merged on their raw bm25 scores (negative, lower
+// is better), so a strong match stays ahead of a weak one from either table.
+// Treatment notes are long and repetitive, so their scores are weighted down
+// to keep a name or history match ahead of an equally scored note.
+const double kPatientSearchWeight = 1.0;
+const double kTreatmentSearchWeight = 0.5;
+
+void weightRanks(std::vector<SearchHit> &hits, size_t from, double weight);
+
+// Turns free text into an FTS5 query: every word must match, the last one as
+// a prefix so results follow the user's typing.
+QString ftsQueryFromInput(const QString &input);
+
+// Searches medical histories and treatment notes/medications and returns the
+// best `limit` hits across both, best first. Ties keep patients ahead.
+std::vector<SearchHit> searchClinic(QSqlDatabase &db, const QString &input, int limit = 50);
+
+// Rebuilds both full-text indexes from the base tables.
+bool rebuildSearchIndex(QSqlDatabase &db);
+
+// Fills a scratch database with `notes` generated treatments and reports the
+// latency of typical searches against it.
+int runSearchBenchmark(int notes);
+
+// --- Patient lookup ---
+// Type-ahead over patient names and contacts. Keys are case- and
+// accent-folded and stored back to back in one byte arena; a sorted array of
+// (offset, length, id) answers a prefix with a binary search. Every word of
+// a name starts a key ("ana maria silva", "maria silva", "silva"), and every
+// group of a contact starts a key with separators removed, so "555 12" finds
+// "+1 555 1234567". Edits go to a small delta layer and deleted ids are
+// hidden from the base. Once needsMerge() the owner builds a fresh index off
+// the GUI thread and swaps it in.
+class PatientPrefixIndex {
+public:
+    struct Hit {
+        int id;
+        QString name;
+        QString contact;
+    };
+
+    struct Row {
+        int id;
+        QString name;
+        QString contact;
+    };
+
+    static QString normalize(const QString &text) {
+        const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+        QString out;
+        out.reserve(decomposed.size());
+        bool pendingSpace = false;
+        for (const QChar c : decomposed) {
+            if (c.category() == QChar::Mark_NonSpacing) continue;
+            if (c.isLetterOrNumber()) {
+                if (pendingSpace && !out.isEmpty()) out += ' ';
+                pendingSpace = false;
+                out += c.toCaseFolded();
+            } else {
+                pendingSpace = true;
+            }
+        }
+        return out;
+    }
+
+    // Reads id, name and contact of every patient and builds the base layer.
+    static PatientPrefixIndex fromDatabase(QSqlDatabase &db) {
+        std::vector<Row> rows;
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("SELECT id, name, contact FROM Patients");
+        if (!execTimed(query, "patients.lookupRows")) {
+            writeLog("Failed to read patients for lookup: " + query.lastError().text(), LogLevel::Error);
+        }
+        while (query.next())
+            rows.push_back(Row{query.value(0).toInt(), query.value(1).toString(), query.value(2).toString()});
+        PatientPrefixIndex index;
+        index.build(rows);
+        return index;
+    }
+
+    void build(const std::vector<Row> &rows) {
+        base = Layer();
+        delta = Layer();
+        removed.clear();
+        for (const Row &row : rows) base.add(row);
+        base.finish();
+    }
+
+    void upsert(const Row &row) {
+        remove(row.id);
+        delta.add(row);
+        delta.finish();
+    }
+
+    void remove(int id) {
+        if (delta.erase(id)) delta.finish();
+        if (base.record(id)) removed.insert(id);
+    }
+
+    // Up to `limit` patients with a key starting with the folded input.
+    std::vector<Hit> lookup(const QString &input, int limit = 20) const {
+        std::vector<Hit> hits;
+        const QString folded = normalize(input);
+        if (folded.isEmpty()) return hits;
+        QString compact = folded;
+        compact.remove(' ');
+
+        std::vector<int> seen;
+        auto collect = [&](const Layer &layer, const std::string &prefix, bool isBase) {
+            auto it = std::lower_bound(layer.keys.begin(), layer.keys.end(), prefix,
+                                       [&](const Key &k, const std::string &p) { return layer.key(k) < p; });
+            for (; it != layer.keys.end() && static_cast<int>(hits.size()) < limit; ++it) {
+                std::string_view key = layer.key(*it);
+                if (key.compare(0, prefix.size(), prefix) != 0) break;
+                if (isBase && removed.count(it->id)) continue;
+                if (std::find(seen.begin(), seen.end(), it->id) != seen.end()) continue;
+                seen.push_back(it->id);
+                const Record *r = layer.record(it->id);
+                if (r) hits.push_back(Hit{it->id, layer.text(r->offset, r->nameLength),
+                                          layer.text(r->offset + r->nameLength, r->contactLength)});
+            }
+        };
+        for (const std::string &prefix : {folded.toStdString(), compact.toStdString()}) {
+            collect(delta, prefix, false);
+            collect(base, prefix, true);
+            if (compact == folded) break;
+        }
+        return hits;
+    }
+
+    // True once the delta has grown enough that lookups pay for searching it.
+    bool needsMerge() const { return delta.keys.size() > kMaxDeltaKeys; }
+
+    size_t patientCount() const { return base.records.size() - removed.size() + delta.records.size(); }
+    size_t keyCount() const { return base.keys.size() + delta.keys.size(); }
+
+    size_t memoryBytes() const {
+        // Hash nodes of the removed set cost roughly three words each.
+        return base.memoryBytes() + delta.memoryBytes() + removed.size() * 3 * sizeof(void *) +
+               removed.bucket_count() * sizeof(void *);
+    }
+
+private:
+    static constexpr size_t kMaxDeltaKeys = 4096;
+
+    struct Key {
+        quint32 offset;
+        quint16 length;
+        qint32 id;
+    };
+
+    // Display text (name then contact, UTF-8) of one patient.
+    struct Record {
+        qint32 id;
+        quint32 offset;
+        quint16 nameLength;
+        quint16 contactLength;
+    };
+
+    struct Layer {
+        std::string arena;
+        std::vector<Key> keys;         // sorted by key text
+        std::vector<Record> records;   // sorted by id
+
+        std::string_view key(const Key &k) const { return std::string_view(arena).substr(k.offset, k.length); }
+
+        QString text(quint32 offset, quint16 length) const {
+            return QString::fromUtf8(arena.data() + offset, length);
+        }
+
+        void add(const Row &row) {
+            const QByteArray name = row.name.toUtf8().left(0xffff);
+            const QByteArray contact = row.contact.toUtf8().left(0xffff);
+            records.push_back(Record{row.id, static_cast<quint32>(arena.size()),
+                                     static_cast<quint16>(name.size()), static_cast<quint16>(contact.size())});
+            arena.append(name.constData(), name.size());
+            arena.append(contact.constData(), contact.size());
+
+            addKeys(row.id, normalize(row.name).toUtf8(), true);
+            addKeys(row.id, normalize(row.contact).toUtf8(), false);
+        }
+
+        // One key per word start. Contact keys drop the spaces between groups.
+        void addKeys(int id, const QByteArray &folded, bool keepSpaces) {
+            if (folded.isEmpty()) return;
+            QByteArray text = folded;
+            std::vector<int> starts{0};
+            if (keepSpaces) {
+                for (int i = 1; i < text.size(); ++i)
+                    if (text[i - 1] == ' ') starts.push_back(i);
+            } else {
+                QByteArray joined;
+                for (int i = 0; i < text.size(); ++i) {
+                    if (text[i] == ' ') starts.push_back(joined.size());
+                    else joined += text[i];
+                }
+                text = joined;
+            }
+            const quint32 offset = static_cast<quint32>(arena.size());
+            arena.append(text.constData(), std::min<int>(text.size(), 0xffff));
+            for (int start : starts) {
+                int length = std::min<int>(text.size(), 0xffff) - start;
+                if (length > 0) keys.push_back(Key{offset + start, static_cast<quint16>(length), id});
+            }
+        }
+
+        void finish() {
+            std::sort(keys.begin(), keys.end(), [this](const Key &a, const Key &b) { return key(a) < key(b); });
+            std::sort(records.begin(), records.end(), [](const Record &a, const Record &b) { return a.id < b.id; });
+        }
+
+        const Record *record(int id) const {
+            auto it = std::lower_bound(records.begin(), records.end(), id,
+                                       [](const Record &r, int value) { return r.id < value; });
+            return it != records.end() && it->id == id ? &*it : nullptr;
+        }
+
+        // Drops id from the delta layer; its arena bytes are reclaimed on rebuild.
+        bool erase(int id) {
+            size_t before = records.size();
+            records.erase(std::remove_if(records.begin(), records.end(), [id](const Record &r) { return r.id == id; }),
+                          records.end());
+            keys.erase(std::remove_if(keys.begin(), keys.end(), [id](const Key &k) { return k.id == id; }), keys.end());
+            return records.size() != before;
+        }
+
+        size_t memoryBytes() const {
+            return arena.capacity() + keys.capacity() * sizeof(Key) + records.capacity() * sizeof(Record);
+        }
+    };
+
+    Layer base;
+    Layer delta;
+    std::unordered_set<int> removed;   // ids hidden from the base layer
+};
+
+// --- Bulk import ---
+// Streams CSV (with a header row) or JSON Lines into one table. Rows are
+// validated into the Patient/Appointment/Treatment structs and written in
+// chunked transactions. Each chunk's transaction also saves the file offset
+// to ImportState, so an interrupted import resumes exactly after the last
+// committed chunk. Rows that fail validation or insertion go to
+// <file>.rejects, whose committed length is part of the checkpoint.
+const char *tableName(ClinicTable table) {
+    switch (table) {
+    case ClinicTable::Patients: return "Patients";
+    case ClinicTable::Appointments: return "Appointments";
+    case ClinicTable::Treatments: return "Treatments";
+    }
+    return "";
+}
+
+bool parseClinicTable(const QString &name, ClinicTable *table);
+
+struct ImportProgress {
+    qint64 bytesRead;
+    qint64 totalBytes;
+    qint64 rowsImported;
+    qint64 rowsRejected;
+};
+
+struct ImportResult {
+    bool ok = false;
+    bool cancelled = false;
+    qint64 rowsImported = 0;
+    qint64 rowsRejected = 0;
+    QString error;
+};
+
+// One input row, addressed by column name for both CSV and JSON Lines.
+struct ImportRow {
+    const QHash<QString, int> *columns = nullptr;
+    QStringList fields;
+    QJsonObject json;
+
+    bool has(const QString &name) const {
+        if (columns) return columns->contains(name);
+        return json.contains(name);
+    }
+
+    QString text(const QString &name) const {
+        if (columns) {
+            int i = columns->value(name, -1);
+            return i >= 0 && i < fields.size() ? fields[i] : QString();
+        }
+        QJsonValue v = json.value(name);
+        if (v.isDouble()) return QString::number(v.toDouble(), 'g', 15);
+        if (v.isBool()) return v.toBool() ? "1" : "0";
+        return v.toString();
+    }
+
+    QStringList list(const QString &name) const {
+        QStringList items;
+        if (!columns && json.value(name).isArray()) {
+            for (const QJsonValue &v : json.value(name).toArray())
+                items << v.toString().trimmed();
+        } else {
+            items = splitMedications(text(name));
+        }
+        items.removeAll(QString());
+        return items;
+    }
+};
+
+bool importInt(const ImportRow &row, const QString &name, int *out, QString *reason);
+
+bool rowToPatient(const ImportRow &row, Patient *p, QString *reason);
+
+bool rowToAppointment(const ImportRow &row, Appointment *a, QString *reason);
+
+bool rowToTreatment(const ImportRow &row, Treatment *t, QString *reason);
+
+// Splits one CSV record into fields, honouring RFC 4180 quoting.
+QStringList parseCsvRecord(const QString &record);
+
+// Reads the next logical record: one line for JSON Lines, or as many lines as
+// it takes to close an open quote for CSV. Returns false at end of file.
+bool readImportRecord(QFile &file, bool csv, QString *record);
+
+struct ImportCheckpoint {
+    qint64 offset = 0;
+    qint64 rowsImported = 0;
+    qint64 rowsRejected = 0;
+    qint64 recordNumber = 0;
+    qint64 rejectsSize = 0;
+};
+
+// Identifies the input file, so a checkpoint is only resumed for the same
+// unchanged file: size, modification time and a hash of the first 64 KiB.
+struct ImportFingerprint {
+    qint64 size = 0;
+    qint64 modified = 0;
+    QString headHash;
+};
+
+ImportFingerprint fingerprintImportFile(QFile &file);
+
+bool loadImportCheckpoint(QSqlDatabase &db, const QString &key, ClinicTable table,
+                          const ImportFingerprint &f, ImportCheckpoint *cp);
+
+void clearImportCheckpoint(QSqlDatabase &db, const QString &key);
+
+ImportResult importFile(QSqlDatabase &db, ClinicTable table, const QString &path,
+                        const std::function<void(const ImportProgress &)> &progress,
+                        const std::atomic<bool> *cancel = nullptr, int chunkRows = 20000);
+
+// Runs job on a new thread with its own connection to clinic.db. The thread
+// deletes itself when the job returns; the window tracks its jobs through
+// ClinicJobs so they can be joined on exit.
+QThread *runInBackground(const QString &connectionName, std::function<void(QSqlDatabase &)> job);
+
+// --- Export ---
+// Writes one table to CSV or JSON Lines with a forward-only cursor, so memory
+// use does not depend on the table size. Output goes through QSaveFile: an
+// earlier export at path is replaced only once every write has succeeded.
+enum class ExportFormat { Csv, JsonLines };
+
+struct ExportResult {
+    bool ok = false;
+    bool cancelled = false;
+    qint64 rows = 0;
+    QString error;
+};
+
+QByteArray csvField(const QString &value);
+
+ExportResult exportTable(QSqlDatabase &db, ClinicTable table, ExportFormat format, const QString &path,
+                         const std::function<void(qint64 rows, qint64 total)> &progress,
+                         const std::atomic<bool> *cancel = nullptr);
+
+// --- Online backup ---
+// Snapshots of clinic.db are taken from a background connection while the
+// app keeps running, and integrity-checked before they are kept.
+//
+// Stock Qt compiles its own copy of SQLite into the QSQLITE driver, and a
+// handle from that copy must not be passed to a separately linked
+// libsqlite3. Such builds write snapshots with VACUUM INTO through the
+// driver. Builds against a Qt configured with -system-sqlite can define
+// CLINIC_SYSTEM_SQLITE to copy with the online backup API in small page
+// batches instead; startup then fails if the driver's SQLite is not the one
+// linked into the app.
+struct BackupReport {
+    bool ok = false;
+    QString path;
+    QString error;
+    qint64 bytes = 0;
+    qint64 elapsedMs = 0;
+    qint64 maxLockUs = 0;   // longest time the source was held read-locked
+    int restarts = 0;       // backup API copies restarted by other connections' writes
+
+    QString summary() const {
+        if (!ok) return "Backup failed: " + error;
+        double mib = bytes / (1024.0 * 1024.0);
+        return QString("%1: %2 MiB in %3 s (%4 MiB/s), longest lock %5 ms, %6 restarts, integrity ok")
+               .arg(QFileInfo(path).fileName())
+               .arg(mib, 0, 'f', 1)
+               .arg(elapsedMs / 1000.0, 0, 'f', 2)
+               .arg(elapsedMs > 0 ? mib * 1000.0 / elapsedMs : mib, 0, 'f', 1)
+               .arg(maxLockUs / 1000.0, 0, 'f', 1)
+               .arg(restarts);
+    }
+};
+
+struct BackupSettings {
+    QString directory = "backups";
+    int keep = 7;            // snapshots kept; older ones are deleted after each run
+    int intervalHours = 24;  // 0 disables scheduled backups
+    int pagesPerStep = 64;   // backup API builds only
+    int pauseMs = 5;         // backup API builds only
+};
+
+BackupSettings loadBackupSettings();
+
+// Scheduled snapshots are clinic-<time>.db and count against backup/keep;
+// the copy taken before a restore is pre-restore-<time>.db and is never pruned.
+const char kBackupPattern[] = "clinic-*.db";
+const char kPreRestorePattern[] = "pre-restore-*.db";
+
+#ifdef CLINIC_SYSTEM_SQLITE
+// True when the QSQLITE driver runs the SQLite library this program links,
+// which the backup API path needs; checked once at startup.
+bool sqliteLibraryMatches(QSqlDatabase &db, QString *error);
+#endif
+
+// Copies source into a new file at path, recording lock time and restarts.
+bool writeSnapshot(QSqlDatabase &source, const QString &path, const BackupSettings &settings, BackupReport *report);
+
+bool integrityOk(QSqlDatabase &db, QString *error);
+
+// Snapshot files in dir matching patterns, newest first.
+QStringList listBackups(const QString &dir, const QStringList &patterns = QStringList{kBackupPattern});
+
+void pruneBackups(const QString &dir, int keep);
+
+// Writes a snapshot of source to <dir>/<prefix><timestamp>.db. The copy goes
+// to a .partial file that is renamed only once it has passed the integrity
+// check. keep > 0 prunes older scheduled snapshots afterwards.
+BackupReport backupDatabase(QSqlDatabase &source, const BackupSettings &settings,
+                            const QString &prefix = QStringLiteral("clinic-"));
+
+// Replaces the data in target with a snapshot. The snapshot is copied to a
+// scratch file, checked and brought up to the current schema there, then
+// attached and copied table by table in one BEGIN IMMEDIATE transaction, so
+// other connections see either the old or the restored data. The current
+// data is saved as pre-restore-<time>.db first so a restore can be undone.
+BackupReport restoreDatabase(QSqlDatabase &target, const QString &snapshotPath);
+
+// --- Reports ---
+// Appointments and treatments copied into one array per column, so reports
+// are computed in memory instead of with GROUP BY queries against the live
+// database. Dates are Julian day numbers, times minutes after midnight and
+// purposes codes into a dictionary; patients get dense codes from 1 up so
+// per-patient counters stay small whatever the ids are. Deleted rows are only marked dead;
+// refresh() reads rows added since the last load plus the rows named by
+// change events, and falls back to a full load once a quarter is dead or
+// when rows arrive with ids below the last one read.
+struct ReportSnapshot {
+    // Appointments, one entry per row.
+    std::vector<qint32> apptId;
+    std::vector<qint32> apptPatient;    // patient code, see patientCount
+    std::vector<qint32> apptDay;
+    std::vector<qint16> apptMinute;     // -1 when the time does not parse
+    std::vector<qint32> apptPurpose;
+    std::vector<quint8> apptCompleted;
+    std::vector<quint8> apptTreated;    // at least one live treatment
+    std::vector<quint8> apptAlive;
+
+    // Treatments, one entry per row.
+    std::vector<qint32> treatPatient;
+    std::vector<qint32> treatAppointment;
+    std::vector<quint8> treatAlive;
+
+    std::vector<QString> purposes;      // code -> purpose as first written
+
+    // Patient codes run from 1 to patientCount(); 0 is left free for callers.
+    size_t patientCount() const { return size_t(patientCodes.size()); }
+
+    bool load(QSqlDatabase &db) {
+        *this = ReportSnapshot();
+        if (!appendAppointments(db) || !appendTreatments(db)) return false;
+        markTreated();
+        return true;
+    }
+
+    bool refresh(QSqlDatabase &db, const std::vector<RowChange> &changes) {
+        std::vector<qint32> updated;
+        for (const RowChange &c : changes) {
+            // New rows are read by id below, which misses imported rows whose
+            // explicit ids are below the last one seen; bulk inserts may hold
+            // such rows too. Both need a full load.
+            bool appointment = c.table == ClinicTable::Appointments;
+            if (c.op == ChangeOp::BulkInsert ||
+                (c.op == ChangeOp::Insert && c.id <= (appointment ? lastAppointmentId : lastTreatmentId)))
+                return load(db);
+            if (appointment) {
+                if (c.op == ChangeOp::Delete) killAppointment(c.id);
+                else if (c.op == ChangeOp::Update) updated.push_back(c.id);
+            } else if (c.table == ClinicTable::Treatments && c.op == ChangeOp::Delete) {
+                auto range = treatRowsByPair.equal_range(pairKey(c.patientId, c.appointmentId));
+                for (auto it = range.first; it != range.second; ++it) treatAlive[it->second] = 0;
+            }
+            // Treatment updates only touch notes and medications.
+        }
+        if (deadAppointments * 4 > apptId.size()) return load(db);
+        if (!appendAppointments(db) || !reloadAppointments(db, updated) || !appendTreatments(db)) return false;
+        markTreated();
+        return true;
+    }
+
+    size_t appointmentCount() const { return apptId.size() - deadAppointments; }
+
+    size_t memoryBytes() const {
+        size_t bytes = apptId.capacity() * (sizeof(qint32) * 4 + sizeof(qint16) + 3) +
+                       patientCodes.size() * (2 * sizeof(qint32) + 2 * sizeof(void *)) +
+                       treatPatient.capacity() * (sizeof(qint32) * 2 + 1) +
+                       rowById.size() * (sizeof(qint32) + sizeof(quint32) + 2 * sizeof(void *)) +
+                       treatRowsByPair.size() * (sizeof(quint64) + sizeof(quint32) + 2 * sizeof(void *));
+        for (const QString &p : purposes) bytes += sizeof(QString) + p.size() * sizeof(QChar);
+        return bytes;
+    }
+
+private:
+    QHash<QString, qint32> purposeCodes;             // case-folded purpose -> code
+    QHash<qint32, qint32> patientCodes;              // patient id -> code
+    std::unordered_map<qint32, quint32> rowById;     // appointment id -> row
+    std::unordered_multimap<quint64, quint32> treatRowsByPair;   // (patientId, appointmentId) -> treatment rows
+    qint32 lastAppointmentId = 0;
+    qint32 lastTreatmentId = 0;
+    size_t deadAppointments = 0;
+
+    static quint64 pairKey(qint32 patientId, qint32 appointmentId) {
+        return quint64(quint32(patientId)) << 32 | quint32(appointmentId);
+    }
+
+    qint32 patientCode(qint32 patientId) {
+        auto it = patientCodes.constFind(patientId);
+        if (it != patientCodes.constEnd()) return it.value();
+        qint32 code = qint32(patientCodes.size()) + 1;
+        patientCodes.insert(patientId, code);
+        return code;
+    }
+
+    qint32 purposeCode(const QString &purpose) {
+        QString key = purpose.simplified().toCaseFolded();
+        auto it = purposeCodes.constFind(key);
+        if (it != purposeCodes.constEnd()) return it.value();
+        qint32 code = qint32(purposes.size());
+        purposes.push_back(key.isEmpty() ? QString("(none)") : purpose.simplified());
+        purposeCodes.insert(key, code);
+        return code;
+    }
+
+    // Columns of one Appointments row: id, patientId, date, time, purpose, completed.
+    void setAppointment(size_t row, const QSqlQuery &query) {
+        QDate date = QDate::fromString(query.value(2).toString(), "yyyy-MM-dd");
+        QTime time = QTime::fromString(query.value(3).toString(), "HH:mm");
+        apptPatient[row] = patientCode(query.value(1).toInt());
+        apptDay[row] = date.isValid() ? qint32(date.toJulianDay()) : 0;
+        apptMinute[row] = time.isValid() ? qint16(time.hour() * 60 + time.minute()) : qint16(-1);
+        apptPurpose[row] = purposeCode(query.value(4).toString());
+        apptCompleted[row] = query.value(5).toBool() ? 1 : 0;
+    }
+
+    void killAppointment(qint32 id) {
+        auto it = rowById.find(id);
+        if (it == rowById.end() || !apptAlive[it->second]) return;
+        apptAlive[it->second] = 0;
+        ++deadAppointments;
+    }
+
+    bool appendAppointments(QSqlDatabase &db) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("SELECT id, patientId, date, time, purpose, completed FROM Appointments WHERE id > ? ORDER BY id");
+        query.addBindValue(lastAppointmentId);
+        if (!execTimed(query, "reports.appointments")) {
+            writeLog("Failed to load appointments for reports: " + query.lastError().text(), LogLevel::Error);
+            return false;
+        }
+        while (query.next()) {
+            size_t row = apptId.size();
+            qint32 id = query.value(0).toInt();
+            apptId.push_back(id);
+            apptPatient.resize(row + 1);
+            apptDay.resize(row + 1);
+            apptMinute.resize(row + 1);
+            apptPurpose.resize(row + 1);
+            apptCompleted.resize(row + 1);
+            apptTreated.push_back(0);
+            apptAlive.push_back(1);
+            setAppointment(row, query);
+            rowById[id] = quint32(row);
+            lastAppointmentId = std::max(lastAppointmentId, id);
+        }
+        return true;
+    }
+
+    bool reloadAppointments(QSqlDatabase &db, const std::vector<qint32> &ids) {
+        if (ids.empty()) return true;
+        QSqlQuery query(db);
+        query.prepare("SELECT id, patientId, date, time, purpose, completed FROM Appointments WHERE id = ?");
+        for (qint32 id : ids) {
+            auto it = rowById.find(id);
+            if (it == rowById.end() || !apptAlive[it->second]) continue;
+            query.bindValue(0, id);
+            if (!execTimed(query, "reports.appointment")) {
+                writeLog("Failed to reload appointment for reports: " + query.lastError().text(), LogLevel::Error);
+                return false;
+            }
+            if (query.next()) setAppointment(it->second, query);
+            else killAppointment(id);
+        }
+        return true;
+    }
+
+    bool appendTreatments(QSqlDatabase &db) {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("SELECT id, patientId, appointmentId FROM Treatments WHERE id > ? ORDER BY id");
+        query.addBindValue(lastTreatmentId);
+        if (!execTimed(query, "reports.treatments")) {
+            writeLog("Failed to load treatments for reports: " + query.lastError().text(), LogLevel::Error);
+            return false;
+        }
+        while (query.next()) {
+            lastTreatmentId = std::max(lastTreatmentId, query.value(0).toInt());
+            treatPatient.push_back(query.value(1).toInt());
+            treatAppointment.push_back(query.value(2).toInt());
+            treatAlive.push_back(1);
+            treatRowsByPair.emplace(pairKey(treatPatient.back(), treatAppointment.back()), quint32(treatAlive.size() - 1));
+        }
+        return true;
+    }
+
+    // Recomputed as a whole: a treatment may arrive before its appointment
+    // (imports) and a delete only names the patient/appointment pair.
+    void markTreated() {
+        std::fill(apptTreated.begin(), apptTreated.end(), 0);
+        for (size_t i = 0; i < treatAppointment.size(); ++i) {
+            if (!treatAlive[i]) continue;
+            auto it = rowById.find(treatAppointment[i]);
+            if (it != rowById.end()) apptTreated[it->second] = 1;
+        }
+    }
+};
+
+// Aggregates over the appointments dated from..to. Per-day arrays are indexed
+// by days since `from`.
+struct ClinicReport {
+    QDate from;
+    QDate to;
+    std::vector<int> visits;
+    std::vector<int> completed;
+    std::vector<int> treated;
+    std::array<int, 24> visitsByHour{};
+    std::vector<std::pair<QString, int>> purposes;   // most frequent first
+    std::array<int, 4> patientsByVisits{};           // 1, 2, 3-5 and 6+ visits
+    int threads = 1;
+    qint64 computeUs = 0;
+
+    int total(const std::vector<int> &perDay) const {
+        return std::accumulate(perDay.begin(), perDay.end(), 0);
+    }
+};
+
+// Splits the appointment rows across threads; each fills its own counters
+// and the results are summed. The loops are branch-free: rows outside the
+// range or dead are counted into an extra slot at the end of every array.
+ClinicReport computeReport(const ReportSnapshot &s, const QDate &from, const QDate &to, int threads = 0);
+
+// One report as rows of text, shared by the Reports tab and the CSV writer.
+enum class ReportKind { Visits, Hours, Purposes, RepeatVisits };
+
+struct ReportTable {
+    QStringList header;
+    std::vector<QStringList> rows;
+};
+
+QString percentText(int part, int whole);
+
+ReportTable reportTable(const ClinicReport &r, ReportKind kind, bool byWeek = false);
+
+void writeReportCsv(const ReportTable &table, QIODevice *out);
+
+bool parseReportKind(const QString &name, ReportKind *kind);
+
+#endif // CLINIC_DATA_H
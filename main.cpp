@@ -2,12 +2,16 @@
 #include <QtWidgets/QMainWindow>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QListWidget>
+#include <QtWidgets/QListView>
+#include <QtCore/QAbstractListModel>
+#include <QtCore/QItemSelectionModel>
 #include <QtWidgets/QComboBox>
+#include <QtWidgets/QTabWidget>
+#ifdef CLINIC_COMPILED_UI
+#include "ui_leorio_clinic.h"
+#else
 #include <QtUiTools/QUiLoader>
-#include <QtCore/QFile>
-#include <QtSql/QSqlDatabase>
-#include <QtSql/QSqlQuery>
-#include <QtSql/QSqlError>
+#endif
 #include <QtWidgets/QLineEdit>
 #include <QtWidgets/QTextEdit>
 #include <QtWidgets/QSpinBox>
@@ -16,209 +20,1001 @@
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QCheckBox>
 #include <QtWidgets/QCalendarWidget>
+#include <QtGui/QTextCharFormat>
+#include <QtGui/QColor>
+#include <QtGui/QFont>
+#include <QtWidgets/QStatusBar>
+#include <QtWidgets/QMenu>
+#include <QtWidgets/QFileDialog>
+#include <QtWidgets/QInputDialog>
+#include <QtWidgets/QDialog>
+#include <QtWidgets/QDialogButtonBox>
+#include <QtWidgets/QFormLayout>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QTableWidget>
+#include <QtWidgets/QHeaderView>
+
+#include "clinic_data.h"
+
+// --- Headless commands ---
+bool isHeadlessCommand(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        QByteArray arg(argv[i]);
+        if (arg == "--explain-queries" || arg == "--import" ||
+            arg == "--rebuild-search-index" || arg == "--bench-search" ||
+            arg == "--patients-on" || arg == "--top-medications" ||
+            arg == "--check-slot" || arg == "--free-slots" ||
+            arg == "--backup" || arg == "--restore" || arg == "--report") return true;
+    }
+    return false;
+}
 
-#include <string>
-#include <vector>
+int runHeadlessCommand(const QStringList &args, QSqlDatabase &db) {
+    if (args.contains("--explain-queries")) {
+        explainHotQueries(db);
+        return 0;
+    }
+    if (args.contains("--rebuild-search-index")) {
+        return rebuildSearchIndex(db) ? 0 : 1;
+    }
+    if (args.contains("--bench-search")) {
+        int i = args.indexOf("--bench-search");
+        int notes = i + 1 < args.size() ? args[i + 1].toInt() : 0;
+        return runSearchBenchmark(notes > 0 ? notes : 1000000);
+    }
 
-// --- Structs ---
-struct Patient {
-    int id;
-    std::string name;
-    int age;
-    std::string contact;
-    std::string medicalHistory;
-};
+    QTextStream out(stdout);
+    if (args.contains("--patients-on")) {
+        int i = args.indexOf("--patients-on");
+        if (i + 1 >= args.size()) {
+            out << "usage: clinic --patients-on <medication>\n";
+            return 2;
+        }
+        for (const PatientSummary &p : getPatientsOnMedication(db, args[i + 1]))
+            out << p.id << "\t" << p.name << "\n";
+        return 0;
+    }
+    if (args.contains("--top-medications")) {
+        int i = args.indexOf("--top-medications");
+        int limit = i + 1 < args.size() ? args[i + 1].toInt() : 0;
+        for (const MedicationCount &m : getTopMedications(db, limit > 0 ? limit : 10))
+            out << m.prescriptions << "\t" << m.name << "\n";
+        return 0;
+    }
 
-struct Appointment {
-    int id;
-    int patientId;
-    std::string date;
-    std::string time;
-    std::string purpose;
-    bool completed;
-};
+    if (args.contains("--check-slot")) {
+        int i = args.indexOf("--check-slot");
+        if (i + 4 >= args.size()) {
+            out << "usage: clinic --check-slot <patientId> <yyyy-MM-dd> <HH:mm> <minutes>\n";
+            return 2;
+        }
+        Appointment a{0, args[i + 1].toInt(), args[i + 2].toStdString(), args[i + 3].toStdString(),
+                      std::string(), false, args[i + 4].toInt()};
+        SlotCheck check = checkAppointmentSlot(db, a, loadScheduleRules());
+        out << (check.free ? QString("free") : "taken: " + check.reason) << "\n";
+        return check.free ? 0 : 1;
+    }
+    if (args.contains("--free-slots")) {
+        int i = args.indexOf("--free-slots");
+        QDate from = i + 2 < args.size() ? QDate::fromString(args[i + 1], "yyyy-MM-dd") : QDate();
+        QDate to = i + 2 < args.size() ? QDate::fromString(args[i + 2], "yyyy-MM-dd") : QDate();
+        int duration = i + 3 < args.size() ? args[i + 3].toInt() : 30;
+        int count = i + 4 < args.size() ? args[i + 4].toInt() : 10;
+        if (!from.isValid() || !to.isValid()) {
+            out << "usage: clinic --free-slots <from yyyy-MM-dd> <to yyyy-MM-dd> [minutes] [count]\n";
+            return 2;
+        }
+        for (const FreeSlot &slot : findFreeSlots(db, from, to, duration, count, loadScheduleRules()))
+            out << slot.date.toString("yyyy-MM-dd") << " " << slot.start.toString("HH:mm") << "\n";
+        return 0;
+    }
 
-struct Treatment {
-    int id;
-    int patientId;
-    int appointmentId;
-    std::string notes;
-    std::vector<std::string> medications;
-};
+    if (args.contains("--backup")) {
+        int i = args.indexOf("--backup");
+        BackupSettings settings = loadBackupSettings();
+        if (i + 1 < args.size() && !args[i + 1].startsWith("--")) settings.directory = args[i + 1];
+        BackupReport r = backupDatabase(db, settings);
+        out << r.summary() << "\n";
+        return r.ok ? 0 : 1;
+    }
+    if (args.contains("--restore")) {
+        int i = args.indexOf("--restore");
+        if (i + 1 >= args.size()) {
+            out << "usage: clinic --restore <snapshot.db>\n";
+            return 2;
+        }
+        BackupReport r = restoreDatabase(db, args[i + 1]);
+        out << (r.ok ? "Restored " + r.summary() : "Restore failed: " + r.error) << "\n";
+        return r.ok ? 0 : 1;
+    }
 
-void writeLog(const QString &message) {
-    QFile file("clinic_debug.log");
-    if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << message << "\n";
-        file.close();
+    if (args.contains("--report")) {
+        int i = args.indexOf("--report");
+        ReportKind kind;
+        QDate from = i + 3 < args.size() ? QDate::fromString(args[i + 2], "yyyy-MM-dd") : QDate();
+        QDate to = i + 3 < args.size() ? QDate::fromString(args[i + 3], "yyyy-MM-dd") : QDate();
+        if (!from.isValid() || !to.isValid() || !parseReportKind(args[i + 1], &kind)) {
+            out << "usage: clinic --report <visits|hours|purposes|repeat> <from yyyy-MM-dd> <to yyyy-MM-dd> [week]\n";
+            return 2;
+        }
+        ReportSnapshot snapshot;
+        if (!snapshot.load(db)) return 1;
+        ClinicReport report = computeReport(snapshot, from, to);
+        QBuffer csv;
+        csv.open(QIODevice::WriteOnly);
+        writeReportCsv(reportTable(report, kind, i + 4 < args.size() && args[i + 4] == "week"), &csv);
+        out << QString::fromUtf8(csv.data());
+        return 0;
     }
-}
 
-void createTables(QSqlDatabase &db) {
-    QSqlQuery query(db);
-
-    if (!query.exec("CREATE TABLE IF NOT EXISTS Patients ("
-                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                    "name TEXT,"
-                    "age INTEGER,"
-                    "contact TEXT,"
-                    "medicalHistory TEXT)")) {
-        writeLog("Failed to create Patients table:" + query.lastError().text());
-    } else writeLog("Patients table created or already exists" + query.lastError().text());
-
-    if (!query.exec("CREATE TABLE IF NOT EXISTS Appointments ("
-                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                    "patientId INTEGER,"
-                    "date TEXT,"
-                    "time TEXT,"
-                    "purpose TEXT,"
-                    "completed INTEGER)")) {
-        writeLog("Failed to create Appointments table:" + query.lastError().text());
-    } else writeLog("Appointments table created or already exists");
-
-    if (!query.exec("CREATE TABLE IF NOT EXISTS Treatments ("
-                    "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                    "patientId INTEGER,"
-                    "appointmentId INTEGER,"
-                    "notes TEXT,"
-                    "medications TEXT)")) {
-        writeLog("Failed to create Treatments table:" + query.lastError().text());
-    } else writeLog("Treatments table created or already exists");
+    int i = args.indexOf("--import");
+    ClinicTable table;
+    if (i < 0 || i + 2 >= args.size() || !parseClinicTable(args[i + 1], &table)) {
+        out << "usage: clinic --import <patients|appointments|treatments> <file.csv|file.jsonl>\n";
+        return 2;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    ImportResult r = importFile(db, table, args[i + 2], [&](const ImportProgress &p) {
+        out << QString("%1 rows imported, %2 rejected (%3%)\n")
+               .arg(p.rowsImported).arg(p.rowsRejected)
+               .arg(p.totalBytes > 0 ? p.bytesRead * 100 / p.totalBytes : 100);
+        out.flush();
+    });
+
+    double seconds = timer.elapsed() / 1000.0;
+    out << QString("%1: %2 rows imported, %3 rejected in %4 s\n")
+           .arg(r.ok ? "done" : "stopped: " + r.error)
+           .arg(r.rowsImported).arg(r.rowsRejected).arg(seconds, 0, 'f', 2);
+    return r.ok ? 0 : 1;
 }
 
-bool addPatient(QSqlDatabase &db, const Patient &p) {
-    QSqlQuery query(db);
+// --- Database worker ---
+// Owns a second connection to clinic.db on its own thread. Jobs are callables
+// taking QSqlDatabase& and run in submission order; results come back either
+// through a std::future or a callback invoked on the receiver's thread.
+class DbWorker {
+public:
+    explicit DbWorker(const QString &databaseName) {
+        thread.setObjectName("clinic-db-worker");
+        context = new QObject;
+        context->moveToThread(&thread);
+        thread.start();
+        post([this, databaseName]() {
+            db = QSqlDatabase::addDatabase("QSQLITE", kConnectionName);
+            db.setDatabaseName(databaseName);
+            if (!openConfiguredConnection(db))
+                writeLog("Worker failed to open database: " + db.lastError().text(), LogLevel::Error);
+        });
+    }
 
-    QString name = QString::fromStdString(p.name).replace("'", "''");
-    QString contact = QString::fromStdString(p.contact).replace("'", "''");
-    QString medicalHistory = QString::fromStdString(p.medicalHistory).replace("'", "''");
+    ~DbWorker() { stop(); }
+
+    // Finishes queued jobs, closes the worker connection and joins the thread.
+    // Jobs run in posting order, so quitting from a job posted last drains the
+    // queue first; a quit() from this thread could drop jobs still queued.
+    void stop() {
+        if (!thread.isRunning()) return;
+        post([this]() {
+            releaseRepositories(db);
+            db.close();
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(kConnectionName);
+            thread.quit();
+        });
+        thread.wait();
+        delete context;
+        context = nullptr;
+    }
 
-    QString sql = QString("INSERT INTO Patients (name, age, contact, medicalHistory) "
-                          "VALUES ('%1', %2, '%3', '%4')")
-                          .arg(name)
-                          .arg(p.age)
-                          .arg(contact)
-                          .arg(medicalHistory);
+    template <typename Job>
+    auto submit(Job job) -> std::future<decltype(job(std::declval<QSqlDatabase&>()))> {
+        using Result = decltype(job(std::declval<QSqlDatabase&>()));
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::future<Result> future = promise->get_future();
+        post([this, job, promise]() mutable {
+            if constexpr (std::is_void<Result>::value) {
+                job(db);
+                promise->set_value();
+            } else {
+                promise->set_value(job(db));
+            }
+        });
+        return future;
+    }
 
-    if (!query.exec(sql)) {
-        writeLog("Failed to add patient:" + query.lastError().text());
-        return false;
+    // Runs job on the worker and hands its result to done() on the receiver's
+    // thread. The receiver must outlive the worker.
+    template <typename Job, typename Done>
+    void run(Job job, QObject *receiver, Done done) {
+        post([this, job, receiver, done]() mutable {
+            auto result = job(db);
+            QMetaObject::invokeMethod(receiver, [done, result]() mutable {
+                done(std::move(result));
+            }, Qt::QueuedConnection);
+        });
     }
-    return true;
-}
 
+private:
+    static constexpr const char *kConnectionName = "clinic_worker";
+
+    template <typename Fn>
+    void post(Fn fn) {
+        QMetaObject::invokeMethod(context, std::move(fn), Qt::QueuedConnection);
+    }
+
+    QThread thread;
+    QObject *context = nullptr;
+    QSqlDatabase db;
+};
 
-std::vector<Patient> getAllPatients(QSqlDatabase &db) {
-    std::vector<Patient> patients;
-    QSqlQuery query(db);
-    if (!query.exec("SELECT id, name, age, contact, medicalHistory FROM Patients")) return patients;
 
-    while (query.next()) {
-        patients.push_back(Patient{
-            query.value(0).toInt(),
-            query.value(1).toString().toStdString(),
-            query.value(2).toInt(),
-            query.value(3).toString().toStdString(),
-            query.value(4).toString().toStdString()
+// --- Patient list model ---
+// Lazily paged list of patient names behind patientListWidget. Pages of
+// id+name are fetched on the worker in id order (keyset pagination) as the
+// view scrolls; full records are loaded only for the selected row. Writes are
+// applied as deltas instead of reloading.
+class PatientListModel : public QAbstractListModel {
+public:
+    static constexpr int kPageSize = 200;
+
+    PatientListModel(DbWorker &worker, QObject *parent = nullptr)
+        : QAbstractListModel(parent), worker(worker) {}
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : static_cast<int>(patients.size());
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override {
+        if (!index.isValid() || index.row() >= static_cast<int>(patients.size())) return QVariant();
+        const PatientSummary &p = patients[index.row()];
+        if (role == Qt::DisplayRole) return p.name;
+        if (role == Qt::UserRole) return p.id;
+        return QVariant();
+    }
+
+    bool canFetchMore(const QModelIndex &parent) const override {
+        return !parent.isValid() && !exhausted && !fetching;
+    }
+
+    void fetchMore(const QModelIndex &parent) override {
+        if (!canFetchMore(parent)) return;
+        fetching = true;
+        int afterId = patients.empty() ? 0 : patients.back().id;
+        int requestGeneration = generation;
+        worker.run([afterId](QSqlDatabase &db) { return getPatientPage(db, afterId, kPageSize); }, this,
+                   [this, requestGeneration](std::vector<PatientSummary> page) {
+            if (requestGeneration != generation) return;
+            appendPage(page);
+            if (reloadTimer.isValid()) {
+                QueryMetrics::instance().record("ui.refreshPatients", reloadTimer.nsecsElapsed() / 1000);
+                reloadTimer.invalidate();
+            }
         });
     }
-    return patients;
-}
 
-bool addTreatment(QSqlDatabase &db, const Treatment &t) {
-    QSqlQuery query(db);
+    // Drops everything loaded so far and starts again from the first page.
+    void reload() {
+        reloadTimer.start();
+        beginResetModel();
+        patients.clear();
+        rowById.clear();
+        exhausted = false;
+        fetching = false;
+        ++generation;
+        endResetModel();
+        fetchMore(QModelIndex());
+    }
 
-    QString notes = QString::fromStdString(t.notes).replace("'", "''");
-    QString meds;
-    for (const auto &m : t.medications)
-        meds += QString::fromStdString(m).replace("'", "''") + ";";
+    int idAt(int row) const {
+        if (row < 0 || row >= static_cast<int>(patients.size())) return -1;
+        return patients[row].id;
+    }
 
-    QString sql = QString("INSERT INTO Treatments (patientId, appointmentId, notes, medications) "
-                          "VALUES (%1, %2, '%3', '%4')")
-                          .arg(t.patientId)
-                          .arg(t.appointmentId)
-                          .arg(notes)
-                          .arg(meds);
+    // Rows stay in id order. An id past the last loaded one is left to a later
+    // fetch unless every page has already arrived.
+    void insertPatient(const PatientSummary &p) {
+        if (rowById.count(p.id)) return;
+        bool pastEnd = patients.empty() || p.id > patients.back().id;
+        if (pastEnd && !exhausted) return;
+
+        auto pos = std::lower_bound(patients.begin(), patients.end(), p.id,
+                                    [](const PatientSummary &a, int id) { return a.id < id; });
+        int row = static_cast<int>(pos - patients.begin());
+        beginInsertRows(QModelIndex(), row, row);
+        patients.insert(pos, p);
+        for (int r = row; r < static_cast<int>(patients.size()); ++r)
+            rowById[patients[r].id] = r;
+        endInsertRows();
+    }
 
-    if (!query.exec(sql)) {
-        writeLog("Failed to add treatment:" + query.lastError().text());
-        return false;
+    // Applies committed patient changes from the ChangeBus.
+    void applyChanges(const std::vector<RowChange> &changes) {
+        // A bulk insert is too many rows to list, and imported ids may fall
+        // anywhere among the loaded pages, so the list starts over.
+        for (const RowChange &c : changes) {
+            if (c.table == ClinicTable::Patients && c.op == ChangeOp::BulkInsert) {
+                reload();
+                return;
+            }
+        }
+        for (const RowChange &c : changes) {
+            if (c.table != ClinicTable::Patients) continue;
+            switch (c.op) {
+            case ChangeOp::Insert: insertPatient(PatientSummary{c.id, c.label}); break;
+            case ChangeOp::Update: updatePatient(PatientSummary{c.id, c.label}); break;
+            case ChangeOp::Delete: removePatient(c.id); break;
+            case ChangeOp::BulkInsert: break;
+            }
+        }
     }
-    return true;
-}
 
+    void updatePatient(const PatientSummary &p) {
+        auto it = rowById.find(p.id);
+        if (it == rowById.end()) return;
+        patients[it->second].name = p.name;
+        QModelIndex idx = index(it->second);
+        emit dataChanged(idx, idx);
+    }
+
+    void removePatient(int id) {
+        auto it = rowById.find(id);
+        if (it == rowById.end()) return;
+        int row = it->second;
+        beginRemoveRows(QModelIndex(), row, row);
+        patients.erase(patients.begin() + row);
+        rowById.erase(it);
+        for (int r = row; r < static_cast<int>(patients.size()); ++r)
+            rowById[patients[r].id] = r;
+        endRemoveRows();
+    }
 
-std::vector<Treatment> getTreatmentsByPatient(QSqlDatabase &db, int patientId) {
-    std::vector<Treatment> treatments;
-    QSqlQuery query(db);
-    query.prepare("SELECT id, patientId, appointmentId, notes, medications FROM Treatments WHERE patientId=?");
-    query.addBindValue(patientId);
-    if (!query.exec()) return treatments;
-
-    while (query.next()) {
-        std::string medsStr = query.value(4).toString().toStdString();
-        std::vector<std::string> meds;
-        size_t pos = 0;
-        while ((pos = medsStr.find(';')) != std::string::npos) {
-            meds.push_back(medsStr.substr(0, pos));
-            medsStr.erase(0, pos + 1);
+private:
+    void appendPage(const std::vector<PatientSummary> &page) {
+        fetching = false;
+        if (static_cast<int>(page.size()) < kPageSize) exhausted = true;
+        if (page.empty()) return;
+
+        int first = static_cast<int>(patients.size());
+        beginInsertRows(QModelIndex(), first, first + static_cast<int>(page.size()) - 1);
+        for (const PatientSummary &p : page) {
+            rowById[p.id] = static_cast<int>(patients.size());
+            patients.push_back(p);
         }
-        treatments.push_back(Treatment{
-            query.value(0).toInt(),
-            query.value(1).toInt(),
-            query.value(2).toInt(),
-            query.value(3).toString().toStdString(),
-            meds
+        endInsertRows();
+    }
+
+    DbWorker &worker;
+    std::vector<PatientSummary> patients;
+    std::unordered_map<int, int> rowById;
+    bool exhausted = false;
+    bool fetching = false;
+    int generation = 0;
+    QElapsedTimer reloadTimer;   // running from reload() until the first page is shown
+};
+
+// --- Appointment cache ---
+// Appointments for the calendar's visible page, loaded with one range query
+// whenever the page changes. Day selection is answered from memory, booked
+// days are highlighted with their count as a tooltip, and writes reload only
+// the day they touch.
+class AppointmentCache {
+public:
+    AppointmentCache(DbWorker &worker, QCalendarWidget *calendar, QObject *receiver)
+        : worker(worker), calendar(calendar), receiver(receiver) {}
+
+    // Called when the appointments of a cached day have changed.
+    std::function<void(const QDate &)> onDayChanged;
+
+    void loadPage(int year, int month) {
+        // A month page shows up to a week of the neighbouring months.
+        QDate first(year, month, 1);
+        QDate from = first.addDays(-7);
+        QDate to = first.addMonths(1).addDays(13);
+        int request = ++generation;
+        QElapsedTimer timer;
+        timer.start();
+
+        worker.run([from, to](QSqlDatabase &db) {
+            return getAppointmentsInRange(db, from.toString("yyyy-MM-dd"), to.toString("yyyy-MM-dd"));
+        }, receiver, [this, from, to, request, timer](std::vector<DayAppointment> rows) {
+            if (request != generation) return;
+            days.clear();
+            dateById.clear();
+            loadedFrom = from;
+            loadedTo = to;
+            for (DayAppointment &a : rows) {
+                QDate date = QDate::fromString(a.date, "yyyy-MM-dd");
+                dateById.insert(a.id, date);
+                days[date].push_back(std::move(a));
+            }
+
+            if (calendar) {
+                calendar->setDateTextFormat(QDate(), QTextCharFormat());
+                for (auto it = days.cbegin(); it != days.cend(); ++it) paintDay(it.key());
+            }
+            if (onDayChanged && calendar) onDayChanged(calendar->selectedDate());
+            QueryMetrics::instance().record("ui.calendarReload", timer.nsecsElapsed() / 1000);
         });
     }
-    return treatments;
+
+    bool contains(const QDate &date) const {
+        return loadedFrom.isValid() && date >= loadedFrom && date <= loadedTo;
+    }
+
+    std::vector<DayAppointment> appointmentsOn(const QDate &date) const {
+        return days.value(date);
+    }
+
+    const DayAppointment *find(int appointmentId) const {
+        auto it = dateById.constFind(appointmentId);
+        if (it == dateById.cend()) return nullptr;
+        auto day = days.constFind(it.value());
+        if (day == days.cend()) return nullptr;
+        for (const DayAppointment &a : day.value())
+            if (a.id == appointmentId) return &a;
+        return nullptr;
+    }
+
+    void invalidateDay(const QDate &date) {
+        if (!contains(date)) return;
+        QString dateStr = date.toString("yyyy-MM-dd");
+        worker.run([dateStr](QSqlDatabase &db) { return getAppointmentsByDate(db, dateStr); }, receiver,
+                   [this, date](std::vector<DayAppointment> rows) {
+            if (!contains(date)) return;
+            for (const DayAppointment &a : days.value(date)) dateById.remove(a.id);
+            for (const DayAppointment &a : rows) dateById.insert(a.id, date);
+            if (rows.empty()) days.remove(date);
+            else days.insert(date, std::move(rows));
+
+            paintDay(date);
+            if (onDayChanged) onDayChanged(date);
+        });
+    }
+
+    // Reloads the day the appointment was cached under, if any.
+    void invalidateAppointment(int appointmentId) {
+        auto it = dateById.find(appointmentId);
+        if (it != dateById.end()) invalidateDay(it.value());
+    }
+
+    // Applies committed changes from the ChangeBus. Appointment writes reload
+    // each touched day once; patient renames and deletes are patched in memory.
+    void applyChanges(const std::vector<RowChange> &changes) {
+        QSet<QDate> reload;
+        QSet<QDate> patched;
+        bool reloadPage = false;
+        for (const RowChange &c : changes) {
+            if (c.table == ClinicTable::Appointments) {
+                if (c.op == ChangeOp::BulkInsert) {
+                    reloadPage = true;
+                    continue;
+                }
+                auto it = dateById.constFind(c.id);
+                if (it != dateById.cend()) reload.insert(it.value());
+                QDate date = QDate::fromString(c.date, "yyyy-MM-dd");
+                if (contains(date)) reload.insert(date);
+            } else if (c.table == ClinicTable::Patients &&
+                       (c.op == ChangeOp::Update || c.op == ChangeOp::Delete)) {
+                for (auto day = days.begin(); day != days.end(); ++day) {
+                    std::vector<DayAppointment> &rows = day.value();
+                    size_t before = rows.size();
+                    bool renamed = false;
+                    if (c.op == ChangeOp::Delete) {
+                        // The calendar joins on Patients, so their appointments drop out.
+                        for (const DayAppointment &a : rows)
+                            if (a.patientId == c.id) dateById.remove(a.id);
+                        rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                                  [&](const DayAppointment &a) { return a.patientId == c.id; }),
+                                   rows.end());
+                    } else {
+                        for (DayAppointment &a : rows) {
+                            if (a.patientId != c.id || a.patientName == c.label) continue;
+                            a.patientName = c.label;
+                            renamed = true;
+                        }
+                    }
+                    if (renamed || rows.size() != before) patched.insert(day.key());
+                }
+            }
+        }
+
+        if (reloadPage || reload.size() > kMaxDayReloads) {
+            if (calendar && loadedFrom.isValid()) loadPage(calendar->yearShown(), calendar->monthShown());
+            return;
+        }
+        for (const QDate &date : patched) {
+            if (days.value(date).empty()) days.remove(date);
+            paintDay(date);
+            if (onDayChanged && !reload.contains(date)) onDayChanged(date);
+        }
+        for (const QDate &date : reload) invalidateDay(date);
+    }
+
+private:
+    // Past this many touched days one range query is cheaper than per-day ones.
+    static constexpr int kMaxDayReloads = 7;
+
+    void paintDay(const QDate &date) {
+        if (!calendar) return;
+        auto day = days.constFind(date);
+        int count = day == days.cend() ? 0 : static_cast<int>(day.value().size());
+        QTextCharFormat format;
+        if (count > 0) {
+            format.setFontWeight(QFont::Bold);
+            format.setBackground(QColor::fromHsv(145, std::min(60 + count * 30, 220), 235));
+            format.setToolTip(QString("%1 appointment%2").arg(count).arg(count == 1 ? QString() : QString("s")));
+        }
+        calendar->setDateTextFormat(date, format);
+    }
+
+    DbWorker &worker;
+    QCalendarWidget *calendar;
+    QObject *receiver;
+    QHash<QDate, std::vector<DayAppointment>> days;
+    QHash<int, QDate> dateById;
+    QDate loadedFrom;
+    QDate loadedTo;
+    int generation = 0;
+};
+
+// --- Treatment history cache ---
+// Treatment histories of recently selected patients, least recently used
+// first out once either the patient or the byte budget is exceeded. A
+// treatment write drops only its patient's entry, and a fetch that was in
+// flight when its patient was invalidated is not cached.
+class TreatmentHistoryCache {
+public:
+    using Rows = std::vector<TreatmentRow>;
+
+    TreatmentHistoryCache(DbWorker &worker, QObject *receiver, size_t maxPatients = 128,
+                          size_t maxBytes = 8 * 1024 * 1024)
+        : worker(worker), receiver(receiver), maxPatients(maxPatients), maxBytes(maxBytes) {}
+
+    // Hands the history to done(), from memory or after a fetch on the worker.
+    void fetch(int patientId, std::function<void(const Rows &)> done) {
+        auto it = entries.find(patientId);
+        if (it != entries.end()) {
+            ++hits;
+            lru.splice(lru.begin(), lru, it->second.position);
+            if (done) done(it->second.rows);
+            return;
+        }
+        ++misses;
+
+        auto waiting = pending.find(patientId);
+        if (waiting != pending.end()) {
+            if (done) waiting->second.push_back(std::move(done));
+            return;
+        }
+        pending[patientId] = done ? std::vector<std::function<void(const Rows &)>>{std::move(done)}
+                                  : std::vector<std::function<void(const Rows &)>>();
+        request(patientId);
+    }
+
+    // Loads the history in the background so a later fetch() is a hit.
+    void prefetch(int patientId) {
+        if (entries.count(patientId) || pending.count(patientId)) return;
+        fetch(patientId, nullptr);
+        --misses;   // not a lookup the user waited for
+    }
+
+    // Only a fetch still in flight can bring back stale rows, so stamps are
+    // kept just for pending patients and dropped when their fetch returns.
+    void invalidate(int patientId) {
+        ++clock;
+        if (pending.count(patientId)) invalidatedAt[patientId] = clock;
+        auto it = entries.find(patientId);
+        if (it == entries.end()) return;
+        bytes -= it->second.bytes;
+        lru.erase(it->second.position);
+        entries.erase(it);
+    }
+
+    void clear() {
+        ++clock;
+        for (const auto &waiting : pending) invalidatedAt[waiting.first] = clock;
+        entries.clear();
+        lru.clear();
+        bytes = 0;
+    }
+
+    void applyChanges(const std::vector<RowChange> &changes) {
+        for (const RowChange &c : changes) {
+            if (c.table == ClinicTable::Treatments && c.op == ChangeOp::BulkInsert) clear();
+            else if (c.table == ClinicTable::Treatments) invalidate(c.patientId);
+            else if (c.table == ClinicTable::Patients && c.op == ChangeOp::Delete) invalidate(c.id);
+        }
+    }
+
+    QString summary() const {
+        quint64 lookups = hits + misses;
+        return QString("history cache %1% hit, %2 patients, %3 KiB")
+               .arg(lookups ? hits * 100 / lookups : 0).arg(entries.size()).arg(bytes / 1024);
+    }
+
+private:
+    struct Entry {
+        Rows rows;
+        size_t bytes;
+        std::list<int>::iterator position;
+    };
+
+    static size_t sizeOf(const Rows &rows) {
+        size_t total = rows.capacity() * sizeof(TreatmentRow);
+        for (const TreatmentRow &r : rows) {
+            total += r.notes.capacity() * sizeof(QChar);
+            for (const QString &m : r.medications) total += sizeof(QString) + m.capacity() * sizeof(QChar);
+        }
+        return total;
+    }
+
+    // Reads the history for pending[patientId]. Rows from a read that was
+    // invalidated while in flight are stale: they are neither cached nor handed
+    // out, and the waiting callbacks get a fresh read instead.
+    void request(int patientId) {
+        quint64 ticket = clock;
+        worker.run([patientId](QSqlDatabase &db) { return getTreatmentHistory(db, patientId); }, receiver,
+                   [this, patientId, ticket](Rows rows) {
+            auto stamp = invalidatedAt.find(patientId);
+            bool current = stamp == invalidatedAt.end() || stamp->second <= ticket;
+            if (stamp != invalidatedAt.end()) invalidatedAt.erase(stamp);
+            if (!current) {
+                if (pending[patientId].empty()) pending.erase(patientId);
+                else request(patientId);
+                return;
+            }
+            auto callbacks = std::move(pending[patientId]);
+            pending.erase(patientId);
+            store(patientId, rows);
+            for (auto &cb : callbacks) cb(rows);
+        });
+    }
+
+    void store(int patientId, const Rows &rows) {
+        invalidate(patientId);
+        size_t size = sizeOf(rows);
+        if (size > maxBytes) return;
+        lru.push_front(patientId);
+        entries.emplace(patientId, Entry{rows, size, lru.begin()});
+        bytes += size;
+        while (!lru.empty() && (entries.size() > maxPatients || bytes > maxBytes)) {
+            auto victim = entries.find(lru.back());
+            bytes -= victim->second.bytes;
+            entries.erase(victim);
+            lru.pop_back();
+        }
+    }
+
+    DbWorker &worker;
+    QObject *receiver;
+    const size_t maxPatients;
+    const size_t maxBytes;
+    std::unordered_map<int, Entry> entries;
+    std::list<int> lru;   // most recently used first
+    std::unordered_map<int, std::vector<std::function<void(const Rows &)>>> pending;
+    std::unordered_map<int, quint64> invalidatedAt;
+    quint64 clock = 0;
+    size_t bytes = 0;
+    quint64 hits = 0;
+    quint64 misses = 0;
+};
+
+// --- Settings dialog ---
+// Edits the SQLite profile. Returns false if the user cancelled.
+bool editSqliteProfile(QWidget *parent, SqliteProfile *profile) {
+    QDialog dialog(parent);
+    dialog.setWindowTitle("Settings");
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QComboBox *preset = new QComboBox(&dialog);
+    preset->addItem("Custom");
+    for (const auto &named : sqliteProfilePresets()) preset->addItem(named.first);
+
+    QComboBox *journal = new QComboBox(&dialog);
+    journal->addItems({"WAL", "DELETE", "TRUNCATE"});
+    QComboBox *sync = new QComboBox(&dialog);
+    sync->addItems({"OFF", "NORMAL", "FULL"});
+    QSpinBox *cache = new QSpinBox(&dialog);
+    cache->setRange(1, 1024 * 1024);
+    cache->setSingleStep(1024);
+    cache->setSuffix(" KiB");
+    QSpinBox *mmap = new QSpinBox(&dialog);
+    mmap->setRange(0, 4096);
+    mmap->setSuffix(" MiB");
+    QComboBox *temp = new QComboBox(&dialog);
+    temp->addItems({"DEFAULT", "FILE", "MEMORY"});
+    QSpinBox *busy = new QSpinBox(&dialog);
+    busy->setRange(0, 60000);
+    busy->setSingleStep(500);
+    busy->setSuffix(" ms");
+
+    auto show = [&](const SqliteProfile &p) {
+        journal->setCurrentText(p.journalMode);
+        sync->setCurrentText(p.synchronous);
+        cache->setValue(p.cacheSizeKiB);
+        mmap->setValue(static_cast<int>(p.mmapSizeBytes / (1024 * 1024)));
+        temp->setCurrentText(p.tempStore);
+        busy->setValue(p.busyTimeoutMs);
+    };
+    show(*profile);
+    QObject::connect(preset, QOverload<int>::of(&QComboBox::currentIndexChanged), [&](int index) {
+        if (index > 0) show(sqliteProfilePresets()[index - 1].second);
+    });
+
+    form->addRow("Preset:", preset);
+    form->addRow("Journal mode:", journal);
+    form->addRow("Synchronous:", sync);
+    form->addRow("Page cache:", cache);
+    form->addRow("Memory map:", mmap);
+    form->addRow("Temp store:", temp);
+    form->addRow("Busy timeout:", busy);
+    form->addRow(new QLabel("Changes apply to open connections immediately.", &dialog));
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+    QObject::connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    QObject::connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted) return false;
+    *profile = SqliteProfile{
+        journal->currentText(),
+        sync->currentText(),
+        cache->value(),
+        qint64(mmap->value()) * 1024 * 1024,
+        temp->currentText(),
+        busy->value()
+    };
+    return true;
+}
+
+// --- Diagnostics dialog ---
+void fillMetricsTable(QTableWidget *table) {
+    const std::map<QString, LatencyStats> all = QueryMetrics::instance().snapshot();
+    table->setRowCount(static_cast<int>(all.size()));
+    int row = 0;
+    auto ms = [](double us) { return QString::number(us / 1000.0, 'f', 2); };
+    for (const auto &entry : all) {
+        const LatencyStats &st = entry.second;
+        const QStringList cells{
+            entry.first,
+            QString::number(st.count),
+            QString::number(st.failures),
+            ms(st.count ? double(st.totalUs) / st.count : 0.0),
+            ms(st.percentileUs(50)),
+            ms(st.percentileUs(95)),
+            ms(st.percentileUs(99)),
+            ms(st.maxUs)
+        };
+        for (int col = 0; col < cells.size(); ++col)
+            table->setItem(row, col, new QTableWidgetItem(cells[col]));
+        ++row;
+    }
 }
 
-bool addAppointment(QSqlDatabase &db, const Appointment &a) {
-    QSqlQuery query(db);
+// Per-statement latency table with the slow-query threshold and a metrics dump.
+void showDiagnostics(QWidget *parent) {
+    QDialog dialog(parent);
+    dialog.setWindowTitle("Diagnostics");
+    dialog.resize(760, 420);
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QTableWidget *table = new QTableWidget(0, 8, &dialog);
+    table->setHorizontalHeaderLabels({"Statement", "Count", "Failed", "Mean ms", "p50 ms", "p95 ms", "p99 ms", "Max ms"});
+    table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->hide();
+    fillMetricsTable(table);
+    form->addRow(table);
+
+    QSpinBox *threshold = new QSpinBox(&dialog);
+    threshold->setRange(1, 60000);
+    threshold->setSuffix(" ms");
+    threshold->setValue(QueryMetrics::instance().slowThreshold());
+    QObject::connect(threshold, QOverload<int>::of(&QSpinBox::valueChanged), [](int value) {
+        QueryMetrics::instance().setSlowThreshold(value);
+        QSettings(kSettingsOrganization, kSettingsApplication).setValue("diagnostics/slowQueryMs", value);
+    });
+    form->addRow("Log queries slower than:", threshold);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+    QPushButton *refresh = buttons->addButton("Refresh", QDialogButtonBox::ActionRole);
+    QPushButton *reset = buttons->addButton("Reset", QDialogButtonBox::ResetRole);
+    QPushButton *save = buttons->addButton("Save metrics...", QDialogButtonBox::ActionRole);
+    QObject::connect(refresh, &QPushButton::clicked, [table]() { fillMetricsTable(table); });
+    QObject::connect(reset, &QPushButton::clicked, [table]() {
+        QueryMetrics::instance().reset();
+        fillMetricsTable(table);
+    });
+    QObject::connect(save, &QPushButton::clicked, [&dialog]() {
+        QString path = QFileDialog::getSaveFileName(&dialog, "Save metrics", "clinic_metrics.json", "JSON (*.json)");
+        if (!path.isEmpty()) QueryMetrics::instance().dump(path);
+    });
+    QObject::connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    form->addRow(buttons);
+
+    dialog.exec();
+}
 
-    QString date = QString::fromStdString(a.date).replace("'", "''");
-    QString time = QString::fromStdString(a.time).replace("'", "''");
-    QString purpose = QString::fromStdString(a.purpose).replace("'", "''");
+// --- Startup timing ---
+// Time spent in each startup phase up to the first event-loop turn. Written
+// to the log at debug level and printed with --startup-timings.
+class StartupTimings {
+public:
+    StartupTimings() { timer.start(); }
+
+    // Ends the current phase under the given name.
+    void mark(const QString &phase) {
+        qint64 now = timer.nsecsElapsed();
+        phases.emplace_back(phase, now - last);
+        last = now;
+    }
 
-    QString sql = QString("INSERT INTO Appointments (patientId, date, time, purpose, completed) "
-                          "VALUES (%1, '%2', '%3', '%4', %5)")
-                          .arg(a.patientId)
-                          .arg(date)
-                          .arg(time)
-                          .arg(purpose)
-                          .arg(a.completed ? 1 : 0);
+    QString report() const {
+        QString out;
+        for (const auto &phase : phases)
+            out += QString("%1 %2 ms\n").arg(phase.first, -22).arg(phase.second / 1e6, 8, 'f', 2);
+        out += QString("%1 %2 ms\n").arg("total", -22).arg(last / 1e6, 8, 'f', 2);
+        return out;
+    }
 
-    if (!query.exec(sql)) {
-        writeLog("Failed to add appointment:" + query.lastError().text());
+private:
+    QElapsedTimer timer;
+    qint64 last = 0;
+    std::vector<std::pair<QString, qint64>> phases;
+};
+
+// Writes the collected metrics to the file given with --metrics-out, if any.
+void dumpMetricsIfRequested(const QStringList &args) {
+    int i = args.indexOf("--metrics-out");
+    if (i >= 0 && i + 1 < args.size()) QueryMetrics::instance().dump(args[i + 1]);
+}
+
+bool openClinicDatabase(QSqlDatabase &db, StartupTimings *timings = nullptr) {
+    QueryMetrics::instance().setSlowThreshold(
+        QSettings(kSettingsOrganization, kSettingsApplication).value("diagnostics/slowQueryMs", 100).toInt());
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(kDatabaseFile);
+    if (!openConfiguredConnection(db)) {
+        return false;
+    }
+    if (timings) timings->mark("open database");
+#ifdef CLINIC_SYSTEM_SQLITE
+    QString mismatch;
+    if (!sqliteLibraryMatches(db, &mismatch)) {
+        writeLog(mismatch, LogLevel::Error);
+        QTextStream(stderr) << mismatch << "\n";
         return false;
     }
+#endif
+
+    // A file already at the current version has every table, index and
+    // trigger, so the DDL only runs for new or older databases.
+    if (schemaVersion(db) < kSchemaVersion) {
+        createTables(db);
+        if (!migrateSchema(db)) {
+            writeLog("Schema migration failed, continuing with current schema", LogLevel::Warning);
+        }
+    }
+    if (timings) timings->mark("schema check");
     return true;
 }
 
+// --- Window background jobs ---
+// Jobs the window runs with runInBackground, and the state their results
+// land in. Lives on the heap, owned by the window, so the jobs never point
+// into main()'s stack. stop() cancels the import and export (both resume or
+// can be rerun) and waits for every job still running; main() calls it
+// before the worker and the logger shut down.
+class ClinicJobs : public QObject {
+public:
+    explicit ClinicJobs(QObject *owner) : QObject(owner) {}
+    ~ClinicJobs() override { stop(); }
+
+    void start(const QString &connectionName, std::function<void(QSqlDatabase &)> job) {
+        threads.erase(std::remove_if(threads.begin(), threads.end(),
+                                     [](const QPointer<QThread> &t) { return t.isNull() || t->isFinished(); }),
+                      threads.end());
+        threads.push_back(runInBackground(connectionName, std::move(job)));
+    }
+
+    void stop() {
+        importCancelled = true;
+        exportCancelled = true;
+        for (const QPointer<QThread> &thread : threads)
+            if (thread) thread->wait();
+        threads.clear();
+    }
+
+    std::atomic<bool> importCancelled{false};
+    std::atomic<bool> exportCancelled{false};
+
+    // Patient lookup index and the changes queued while it is built.
+    std::unique_ptr<PatientPrefixIndex> lookupIndex;
+    std::vector<RowChange> lookupBacklog;
+    bool lookupBuilding = false;
+    bool lookupRebuildPending = false;
+
+    // Reports: the snapshot, the changes since it was read and the last result.
+    std::shared_ptr<ReportSnapshot> reportSnapshot;
+    std::vector<RowChange> reportChanges;
+    bool reportRunning = false;
+    bool reportRerun = false;
+    bool reportReloadPending = false;
+    ClinicReport currentReport;
+    QString reportStats;
+
+    bool backupRunning = false;
+
+private:
+    std::vector<QPointer<QThread>> threads;
+};
+
+// Builds the main window from the form compiled in with uic. Builds without
+// CLINIC_COMPILED_UI load the .ui file at runtime instead (--ui-file <path>
+// picks another one) so the form can be edited without rebuilding; only
+// those builds link QtUiTools.
+QMainWindow *createMainWindow(const QStringList &args) {
+    int i = args.indexOf("--ui-file");
+    QString uiPath = i >= 0 && i + 1 < args.size() ? args[i + 1] : QString();
+#ifdef CLINIC_COMPILED_UI
+    if (!uiPath.isEmpty())
+        writeLog("--ui-file is ignored: this build uses the compiled-in form", LogLevel::Warning);
+    QMainWindow *window = new QMainWindow;
+    Ui::LeoroClinicApp ui;
+    ui.setupUi(window);
+    return window;
+#else
+    if (uiPath.isEmpty()) uiPath = "leorio_clinic.ui";
+
+    QUiLoader loader;
+    QFile uiFile(uiPath);
+    if (!uiFile.open(QFile::ReadOnly)) return nullptr;
+    QMainWindow *window = qobject_cast<QMainWindow*>(loader.load(&uiFile));
+    uiFile.close();
+    return window;
+#endif
+}
 
 int main(int argc, char *argv[]) {
+    if (isHeadlessCommand(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        if (app.arguments().contains("--verbose")) Logger::instance().setMinimumLevel(LogLevel::Debug);
+        QSqlDatabase db;
+        if (!openClinicDatabase(db)) return -1;
+        int rc = runHeadlessCommand(app.arguments(), db);
+        releaseRepositories(db);
+        dumpMetricsIfRequested(app.arguments());
+        Logger::instance().shutdown();
+        return rc;
+    }
+
+    StartupTimings startup;
     QApplication app(argc, argv);
+    if (app.arguments().contains("--verbose")) Logger::instance().setMinimumLevel(LogLevel::Debug);
+    startup.mark("application");
 
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName("clinic.db");
-    if (!db.open()) {
+    QSqlDatabase db;
+    if (!openClinicDatabase(db, &startup)) {
         return -1;
     }
 
-    createTables(db);
-
-    QUiLoader loader;
-    QFile uiFile("leorio_clinic.ui");
-    if (!uiFile.open(QFile::ReadOnly)) return -1;
-    QMainWindow* window = qobject_cast<QMainWindow*>(loader.load(&uiFile));
-    uiFile.close();
+    QMainWindow* window = createMainWindow(app.arguments());
     if (!window) return -1;
+    startup.mark("build window");
     window->show();
+    startup.mark("show window");
+
+    DbWorker worker(kDatabaseFile);
+    ClinicJobs *jobs = new ClinicJobs(window);
 
     // --- Objects ---
-    QListWidget *patientsList = window->findChild<QListWidget*>("patientListWidget");
+    QListView *patientsList = window->findChild<QListView*>("patientListWidget");
+    QLineEdit *patientSearchEdit = window->findChild<QLineEdit*>("patientSearchEdit");
+    QListWidget *searchResultsList = window->findChild<QListWidget*>("searchResultsList");
+    QLineEdit *patientLookupEdit = window->findChild<QLineEdit*>("patientLookupEdit");
+    QListWidget *lookupResultsList = window->findChild<QListWidget*>("lookupResultsList");
     QListWidget *treatmentsList = window->findChild<QListWidget*>("treatmentListWidget");
     QPushButton *addTreatmentBtn = window->findChild<QPushButton*>("addTreatmentBtn");
     QPushButton *addAppointmentBtn = window->findChild<QPushButton*>("addAppointmentBtn");
@@ -229,9 +1025,13 @@ int main(int argc, char *argv[]) {
     QLineEdit *patientContactLineEdit = window->findChild<QLineEdit*>("patientContactEdit");
     QTextEdit *patientHistoryTextEdit = window->findChild<QTextEdit*>("patientMedicalHistoryEdit");
 
+    QCalendarWidget *calendar = window->findChild<QCalendarWidget*>("calendarWidget");
+    QListWidget *appointmentsList = window->findChild<QListWidget*>("appointmentsList");
     QLineEdit *appointmentPatientId = window->findChild<QLineEdit*>("apptPatientIdEdit");
     QDateEdit *appointmentDateEdit = window->findChild<QDateEdit*>("apptDateEdit");
     QTimeEdit *appointmentTimeEdit = window->findChild<QTimeEdit*>("apptTimeEdit");
+    QSpinBox *appointmentDurationSpinBox = window->findChild<QSpinBox*>("apptDurationSpinBox");
+    QPushButton *findSlotsBtn = window->findChild<QPushButton*>("findSlotsBtn");
     QTextEdit *appointmentPurposeTextEdit = window->findChild<QTextEdit*>("apptPurposeEdit");
     QCheckBox *appointmentCompletedCheckBox = window->findChild<QCheckBox*>("apptCompletedCheckBox");
 
@@ -242,49 +1042,154 @@ int main(int argc, char *argv[]) {
     QTextEdit *treatmentMedicationsTextEdit = window->findChild<QTextEdit*>("treatmentMedicationsEdit");
 
 
+    PatientListModel *patientModel = new PatientListModel(worker, window);
+    if (patientsList) {
+        patientsList->setUniformItemSizes(true);
+        patientsList->setModel(patientModel);
+    }
+
     auto refreshPatients = [&]() {
         if (!patientsList || !treatmentPatientId) return;
-        patientsList->clear();
         treatmentPatientId->clear();
-        auto patients = getAllPatients(db);
-        for (const auto &p : patients) {
-            patientsList->addItem(QString::fromStdString(p.name));
-        }
+        patientModel->reload();
     };
 
-    auto refreshAppointments = [&](const QDate &date) {
-        if (!appointmentsList) return;
-        appointmentsList->clear();
+    // The patient shown in the form, picked from the list or from a search hit.
+    int formPatientId = -1;
+    auto currentPatientId = [&]() { return formPatientId; };
 
-        QSqlQuery query(db);
-        query.prepare("SELECT time, patientId, name, purpose FROM Appointments "
-                    "JOIN Patients ON Appointments.patientId = Patients.id "
-                    "WHERE date = ?");
-        query.addBindValue(date.toString("yyyy-MM-dd"));
+    auto showPatient = [&](const Patient &p) {
+        formPatientId = p.id;
+        patientNameLineEdit->setText(QString::fromStdString(p.name));
+        ageSpinBox->setValue(p.age);
+        patientContactLineEdit->setText(QString::fromStdString(p.contact));
+        patientHistoryTextEdit->setPlainText(QString::fromStdString(p.medicalHistory));
+    };
+
+    TreatmentHistoryCache historyCache(worker, window);
+    QTabWidget *tabWidget = window->findChild<QTabWidget*>("tabWidget");
+    QWidget *treatmentsTab = window->findChild<QWidget*>("treatmentsTab");
+
+    auto loadPatient = [&](int patientId) {
+        formPatientId = patientId;
+        historyCache.prefetch(patientId);
+        worker.run([patientId](QSqlDatabase &wdb) { return getPatientById(wdb, patientId); }, window,
+                   [&](Patient p) {
+            // Ignore records that arrive after the selection has moved on.
+            if (p.id <= 0 || p.id != formPatientId) return;
+            showPatient(p);
+        });
+    };
+
+    AppointmentCache appointmentCache(worker, calendar, window);
 
-        if (!query.exec()) {
-            writeLog("Failed to fetch appointments: " + query.lastError().text());
+    auto showAppointments = [&](const QDate &date) {
+        if (!appointmentsList) return;
+        if (!appointmentCache.contains(date)) {
+            appointmentCache.loadPage(date.year(), date.month());
             return;
         }
 
-        while (query.next()) {
-            QString time = query.value(0).toString();
-            int patientId = query.value(1).toInt();
-            QString patientName = query.value(2).toString();
-            QString purpose = query.value(3).toString();
+        appointmentsList->clear();
+        for (const auto &a : appointmentCache.appointmentsOn(date)) {
+            QString line = QString("%1 (%2 min) Patient (%3) %4 %5")
+                            .arg(a.time)
+                            .arg(a.durationMinutes)
+                            .arg(a.patientId)
+                            .arg(a.patientName)
+                            .arg(a.purpose);
+
+            QListWidgetItem *item = new QListWidgetItem(line, appointmentsList);
+            item->setData(Qt::UserRole, a.id);
+        }
+    };
+
+    auto refreshAppointments = [&]() {
+        if (calendar) appointmentCache.loadPage(calendar->yearShown(), calendar->monthShown());
+    };
+
+    auto selectedAppointmentId = [&]() {
+        if (!appointmentsList || !appointmentsList->currentItem()) return -1;
+        return appointmentsList->currentItem()->data(Qt::UserRole).toInt();
+    };
+
+    auto selectedDate = [&]() {
+        return calendar ? calendar->selectedDate() : QDate::currentDate();
+    };
 
-            QString line = QString("%1 Patient (id) %2 %3 %4")
-                            .arg(time)
-                            .arg(patientId)
-                            .arg(patientName)
-                            .arg(purpose);
+    appointmentCache.onDayChanged = [&](const QDate &date) {
+        if (date == selectedDate()) showAppointments(date);
+    };
 
-            appointmentsList->addItem(line);
+    // The patient whose treatments treatmentsList shows.
+    int treatmentsPatientId = -1;
+    auto refreshTreatments = [&](int patientId) {
+        if (!treatmentsList) return;
+        treatmentsPatientId = patientId;
+        historyCache.fetch(patientId, [&, patientId](const TreatmentHistoryCache::Rows &rows) {
+            if (patientId != treatmentsPatientId) return;
+            treatmentsList->clear();
+            for (const TreatmentRow &tr : rows) {
+                QListWidgetItem *item = new QListWidgetItem(tr.notes, treatmentsList);
+                item->setData(Qt::UserRole, tr.appointmentId);
+            }
+        });
+    };
+
+    // Treatments are shown per patient and matched by appointment, as the
+    // repository updates and deletes them.
+    auto applyTreatmentChanges = [&](const std::vector<RowChange> &changes) {
+        if (!treatmentsList || treatmentsPatientId <= 0) return;
+        for (const RowChange &c : changes) {
+            if (c.table == ClinicTable::Patients && c.op == ChangeOp::Delete && c.id == treatmentsPatientId) {
+                treatmentsList->clear();
+                treatmentsPatientId = -1;
+                return;
+            }
+            if (c.table != ClinicTable::Treatments) continue;
+            if (c.op == ChangeOp::BulkInsert) {
+                refreshTreatments(treatmentsPatientId);
+                return;
+            }
+            if (c.patientId != treatmentsPatientId) continue;
+            if (c.op == ChangeOp::Insert) {
+                QListWidgetItem *item = new QListWidgetItem(c.label, treatmentsList);
+                item->setData(Qt::UserRole, c.appointmentId);
+                continue;
+            }
+            for (int row = treatmentsList->count() - 1; row >= 0; --row) {
+                QListWidgetItem *item = treatmentsList->item(row);
+                if (item->data(Qt::UserRole).toInt() != c.appointmentId) continue;
+                if (c.op == ChangeOp::Delete) delete treatmentsList->takeItem(row);
+                else item->setText(c.label);
+            }
         }
     };
 
+    // Every committed write reaches the views through here, whichever
+    // connection made it.
+    ChangeBus::instance().subscribe(window, [&](const std::vector<RowChange> &changes) {
+        historyCache.applyChanges(changes);
+        patientModel->applyChanges(changes);
+        appointmentCache.applyChanges(changes);
+        applyTreatmentChanges(changes);
+        for (const RowChange &c : changes)
+            if (c.table == ClinicTable::Patients && c.op == ChangeOp::Delete && c.id == formPatientId)
+                formPatientId = -1;
+    });
+
+
+    // The first page is requested once the event loop runs.
+    QTimer::singleShot(0, window, [&]() { refreshPatients(); });
 
-    refreshPatients();
+    // Writes run on the worker; the views follow the change events, so only a
+    // failure needs to come back here.
+    auto reportWriteFailure = [&](const QString &action) {
+        return [&, action](bool ok) {
+            if (!ok) QMessageBox::warning(window, "Database Error",
+                                          "Could not " + action + ". Details are in clinic_debug.log.");
+        };
+    };
     // --- Add Patient ---
 
     if (addPatientBtn) {
@@ -306,7 +1211,7 @@ int main(int argc, char *argv[]) {
             p.contact = contact.toStdString();
             p.medicalHistory = medicalHistory.toStdString();
 
-            if (addPatient(db, p)) refreshPatients();
+            worker.run([p](QSqlDatabase &wdb) { return addPatient(wdb, p); }, window, reportWriteFailure("add the patient"));
         });
     }
 
@@ -314,7 +1219,8 @@ int main(int argc, char *argv[]) {
 
     QPushButton *editPatientBtn = window->findChild<QPushButton*>("editPatientBtn");
     QObject::connect(editPatientBtn, &QPushButton::clicked, [&]() {
-        int patientId = patientsList->currentRow() + 1;
+        int patientId = currentPatientId();
+        if (patientId <= 0) return;
         QString name = patientNameLineEdit->text().trimmed();
         int age = ageSpinBox->value();
         QString contact = patientContactLineEdit->text().trimmed();
@@ -325,69 +1231,179 @@ int main(int argc, char *argv[]) {
             return;
         }
 
-        QSqlQuery query(db);
-        query.prepare("UPDATE Patients SET name=?, age=?, contact=?, medicalHistory=? WHERE id=?");
-        query.addBindValue(name);
-        query.addBindValue(age);
-        query.addBindValue(contact);
-        query.addBindValue(medicalHistory);
-        query.addBindValue(patientId);
-
-        if (!query.exec()) {
-            writeLog("Failed to edit patient: " + query.lastError().text());
-            return;
-        }
-
-        refreshPatients();
+        Patient p{patientId, name.toStdString(), age, contact.toStdString(), medicalHistory.toStdString()};
+        worker.run([p](QSqlDatabase &wdb) { return updatePatient(wdb, p); }, window, reportWriteFailure("update the patient"));
     });
 
     // --- Delete Patient ---
     QPushButton *deletePatientBtn = window->findChild<QPushButton*>("deletePatientBtn");
     QObject::connect(deletePatientBtn, &QPushButton::clicked, [&]() {
-        int patientId = patientsList->currentRow() + 1;
+        int patientId = currentPatientId();
         if (patientId <= 0) return;
 
-        QSqlQuery query(db);
-        query.prepare("DELETE FROM Patients WHERE id=?");
-        query.addBindValue(patientId);
-        if (!query.exec()) writeLog("Failed to delete patient: " + query.lastError().text());
-
-        refreshPatients();
+        worker.run([patientId](QSqlDatabase &wdb) { return deletePatient(wdb, patientId); }, window,
+                   reportWriteFailure("delete the patient"));
     });
 
     // --- Load data for selected patient ---
 
-    QObject::connect(patientsList, &QListWidget::currentRowChanged, [&](int row){
-        if (row < 0) return;
-        auto patients = getAllPatients(db);
-        if (row >= patients.size()) return;
+    QObject::connect(patientsList->selectionModel(), &QItemSelectionModel::currentRowChanged,
+                     [&](const QModelIndex &current, const QModelIndex &) {
+        int patientId = patientModel->idAt(current.row());
+        if (patientId <= 0) return;
+        loadPatient(patientId);
+        if (tabWidget && tabWidget->currentWidget() == treatmentsTab) refreshTreatments(patientId);
+    });
 
-        const Patient &p = patients[row];
+    // --- Search ---
+    // Queries run on the worker 200 ms after the last keystroke; results from
+    // an older search are dropped if a newer one has been issued.
+    QTimer searchDebounce;
+    searchDebounce.setSingleShot(true);
+    searchDebounce.setInterval(200);
+    int searchSequence = 0;
+    if (patientSearchEdit && searchResultsList) {
+        searchResultsList->hide();
+        QObject::connect(patientSearchEdit, &QLineEdit::textChanged, [&]() { searchDebounce.start(); });
+        QObject::connect(&searchDebounce, &QTimer::timeout, [&]() {
+            QString text = patientSearchEdit->text().trimmed();
+            int sequence = ++searchSequence;
+            if (text.isEmpty()) {
+                searchResultsList->clear();
+                searchResultsList->hide();
+                return;
+            }
+            worker.run([text](QSqlDatabase &wdb) { return searchClinic(wdb, text); }, window,
+                       [&, sequence](std::vector<SearchHit> hits) {
+                if (sequence != searchSequence) return;
+                searchResultsList->clear();
+                for (const SearchHit &hit : hits) {
+                    QListWidgetItem *item = new QListWidgetItem(
+                        QString("%1 (%2): %3").arg(hit.patientName).arg(hit.patientId).arg(hit.snippet),
+                        searchResultsList);
+                    item->setData(Qt::UserRole, hit.patientId);
+                }
+                if (hits.empty()) searchResultsList->addItem("No matches");
+                searchResultsList->show();
+            });
+        });
+        QObject::connect(searchResultsList, &QListWidget::itemClicked, [&](QListWidgetItem *item) {
+            int patientId = item->data(Qt::UserRole).toInt();
+            if (patientId > 0) loadPatient(patientId);
+        });
+    }
 
-        patientNameLineEdit->setText(QString::fromStdString(p.name));
-        ageSpinBox->setValue(p.age);
-        patientContactLineEdit->setText(QString::fromStdString(p.contact));
-        patientHistoryTextEdit->setPlainText(QString::fromStdString(p.medicalHistory));
-    });
+    auto appointmentDuration = [&]() {
+        return appointmentDurationSpinBox ? appointmentDurationSpinBox->value() : 30;
+    };
+    auto showBookingConflict = [&](const QString &conflict) {
+        if (!conflict.isEmpty()) QMessageBox::warning(window, "Appointment not saved", conflict);
+    };
+
+    // --- Patient lookup ---
+    // The prefix index is built on a background connection at startup and
+    // answered on this thread. Patient changes that commit while it is being
+    // built are queued and replayed once it is installed. When the delta layer
+    // outgrows needsMerge() the same background build replaces it; the old
+    // index keeps answering (and taking changes) until the swap.
+    std::function<void()> buildLookupIndex;
+    std::function<void(const std::vector<RowChange> &)> applyLookupChanges =
+        [jobs, &buildLookupIndex](const std::vector<RowChange> &changes) {
+        for (const RowChange &c : changes) {
+            if (c.table != ClinicTable::Patients) continue;
+            if (c.op == ChangeOp::BulkInsert) {
+                if (jobs->lookupBuilding) jobs->lookupRebuildPending = true;
+                else buildLookupIndex();
+                continue;
+            }
+            if (jobs->lookupBuilding) jobs->lookupBacklog.push_back(c);
+            if (jobs->lookupIndex) {
+                if (c.op == ChangeOp::Delete) jobs->lookupIndex->remove(c.id);
+                else jobs->lookupIndex->upsert(PatientPrefixIndex::Row{c.id, c.label, c.contact});
+            }
+        }
+        if (jobs->lookupIndex && jobs->lookupIndex->needsMerge() && !jobs->lookupBuilding) buildLookupIndex();
+    };
+    // Results are posted to jobs, so they are dropped if the window is gone;
+    // the main() locals they call only run from the event loop.
+    buildLookupIndex = [jobs, &applyLookupChanges, &buildLookupIndex]() {
+        jobs->lookupBuilding = true;
+        jobs->start("clinic_lookup", [jobs, &applyLookupChanges, &buildLookupIndex](QSqlDatabase &ldb) {
+            QElapsedTimer timer;
+            timer.start();
+            auto index = std::make_shared<PatientPrefixIndex>(PatientPrefixIndex::fromDatabase(ldb));
+            qint64 ms = timer.elapsed();
+            QMetaObject::invokeMethod(jobs, [jobs, &applyLookupChanges, &buildLookupIndex, index, ms]() {
+                jobs->lookupIndex = std::make_unique<PatientPrefixIndex>(std::move(*index));
+                jobs->lookupBuilding = false;
+                std::vector<RowChange> backlog;
+                backlog.swap(jobs->lookupBacklog);
+                applyLookupChanges(backlog);
+                writeLog(QString("Patient lookup index: %1 patients, %2 keys, %3 MiB, built in %4 ms")
+                         .arg(jobs->lookupIndex->patientCount()).arg(jobs->lookupIndex->keyCount())
+                         .arg(jobs->lookupIndex->memoryBytes() / (1024.0 * 1024.0), 0, 'f', 1).arg(ms));
+                if (jobs->lookupRebuildPending) {
+                    jobs->lookupRebuildPending = false;
+                    buildLookupIndex();
+                }
+            }, Qt::QueuedConnection);
+        });
+    };
+    ChangeBus::instance().subscribe(window, applyLookupChanges);
+    buildLookupIndex();
+
+    if (patientLookupEdit && lookupResultsList) {
+        lookupResultsList->hide();
+        QObject::connect(patientLookupEdit, &QLineEdit::textChanged, [&](const QString &text) {
+            lookupResultsList->clear();
+            if (text.trimmed().isEmpty()) {
+                lookupResultsList->hide();
+                return;
+            }
+            if (!jobs->lookupIndex) {
+                lookupResultsList->addItem("Loading patients...");
+            } else {
+                QElapsedTimer timer;
+                timer.start();
+                std::vector<PatientPrefixIndex::Hit> hits = jobs->lookupIndex->lookup(text);
+                QueryMetrics::instance().record("ui.patientLookup", timer.nsecsElapsed() / 1000);
+                for (const auto &hit : hits) {
+                    QListWidgetItem *item = new QListWidgetItem(
+                        QString("%1 (%2) %3").arg(hit.name).arg(hit.id).arg(hit.contact), lookupResultsList);
+                    item->setData(Qt::UserRole, hit.id);
+                }
+                if (hits.empty()) lookupResultsList->addItem("No matches");
+            }
+            lookupResultsList->show();
+        });
+        QObject::connect(lookupResultsList, &QListWidget::itemClicked, [&](QListWidgetItem *item) {
+            int patientId = item->data(Qt::UserRole).toInt();
+            if (patientId > 0) loadPatient(patientId);
+        });
+    }
 
     if (addAppointmentBtn) {
         QObject::connect(addAppointmentBtn, &QPushButton::clicked, [&]() {
             int patientId = appointmentPatientId->text().toInt();
-            writeLog("id");
+            writeLog(QString("Adding appointment for patient %1").arg(patientId), LogLevel::Debug);
             QString date = appointmentDateEdit->date().toString("yyyy-MM-dd");
             QString time = appointmentTimeEdit->time().toString("HH:mm");
             QString purpose = appointmentPurposeTextEdit->toPlainText().trimmed();
 
-            bool completed = false; // or read from a checkbox if you have one
+            bool completed = appointmentCompletedCheckBox->isChecked();
 
             if (patientId <= 0 || date.isEmpty() || time.isEmpty() || purpose.isEmpty()) {
                 QMessageBox::warning(window, "Incomplete Data", "Please fill all required appointment fields.");
                 return;
             }
 
-            Appointment a{0, patientId, date.toStdString(), time.toStdString(), purpose.toStdString(), completed};
-            addAppointment(db, a);
-            refreshAppointments();
+            Appointment a{0, patientId, date.toStdString(), time.toStdString(), purpose.toStdString(), completed,
+                          appointmentDuration()};
+            worker.run([a](QSqlDatabase &wdb) {
+                QString conflict;
+                bookAppointment(wdb, a, &conflict);
+                return conflict;
+            }, window, showBookingConflict);
         });
     }
 
@@ -395,75 +1411,463 @@ int main(int argc, char *argv[]) {
     QPushButton *editAppointmentBtn = window->findChild<QPushButton*>("updateAppointmentBtn");
 
     QObject::connect(editAppointmentBtn, &QPushButton::clicked, [&]() {
+        int appointmentId = selectedAppointmentId();
+        if (appointmentId <= 0) return;
         int patientId = appointmentPatientId->text().toInt();
-        int appointmentId = appointmentPatientId->text().toInt();
         QString date = appointmentDateEdit->date().toString("yyyy-MM-dd");
         QString time = appointmentTimeEdit->time().toString("HH:mm");
         QString purpose = appointmentPurposeTextEdit->toPlainText().trimmed();
         bool completed = appointmentCompletedCheckBox->isChecked();
 
-        QSqlQuery query(db);
-        query.prepare("UPDATE Appointments SET patientId=?, date=?, time=?, purpose=?, completed=? WHERE id=?");
-        query.addBindValue(patientId);
-        query.addBindValue(date);
-        query.addBindValue(time);
-        query.addBindValue(purpose);
-        query.addBindValue(completed ? 1 : 0);
-        query.addBindValue(appointmentId);
-
-        if (!query.exec()) writeLog("Failed to edit appointment: " + query.lastError().text());
-        refreshAppointments();
+        Appointment a{appointmentId, patientId, date.toStdString(), time.toStdString(), purpose.toStdString(), completed,
+                      appointmentDuration()};
+        worker.run([a](QSqlDatabase &wdb) {
+            QString conflict;
+            bookAppointment(wdb, a, &conflict);
+            return conflict;
+        }, window, showBookingConflict);
     });
 
+    // --- Find free slots ---
+    // Offers the next free starts over four weeks from the date in the form and
+    // fills the date and time with the one picked.
+    if (findSlotsBtn) {
+        QObject::connect(findSlotsBtn, &QPushButton::clicked, [&]() {
+            QDate from = appointmentDateEdit->date();
+            int patientId = appointmentPatientId->text().toInt();
+            int duration = appointmentDuration();
+            worker.run([from, patientId, duration](QSqlDatabase &wdb) {
+                return findFreeSlots(wdb, from, from.addDays(27), duration, 10, loadScheduleRules(), patientId,
+                                     QDateTime::currentDateTime());
+            }, window, [&, duration](std::vector<FreeSlot> slots) {
+                if (slots.empty()) {
+                    QMessageBox::information(window, "Free slots",
+                                             QString("No free %1-minute slot in the next four weeks.").arg(duration));
+                    return;
+                }
+                QStringList labels;
+                for (const FreeSlot &slot : slots)
+                    labels << slot.date.toString("ddd yyyy-MM-dd") + " " + slot.start.toString("HH:mm");
+                bool ok = false;
+                QString picked = QInputDialog::getItem(window, "Free slots", "Book at:", labels, 0, false, &ok);
+                int index = labels.indexOf(picked);
+                if (!ok || index < 0) return;
+                appointmentDateEdit->setDate(slots[index].date);
+                appointmentTimeEdit->setTime(slots[index].start);
+            });
+        });
+    }
+
     // --- Delete Appointment ---
     QPushButton *deleteAppointmentBtn = window->findChild<QPushButton*>("deleteAppointmentBtn");
     QObject::connect(deleteAppointmentBtn, &QPushButton::clicked, [&]() {
-        int appointmentId = appointmentPatientId->text().toInt();
+        int appointmentId = selectedAppointmentId();
         if (appointmentId <= 0) return;
 
-        QSqlQuery query(db);
-        query.prepare("DELETE FROM Appointments WHERE id=?");
-        query.addBindValue(appointmentId);
-        if (!query.exec()) writeLog("Failed to delete appointment: " + query.lastError().text());
-        refreshAppointments();
+        worker.run([appointmentId](QSqlDatabase &wdb) { return deleteAppointment(wdb, appointmentId); }, window,
+                   reportWriteFailure("delete the appointment"));
     });
 
-    QCalendarWidget *calendar = window->findChild<QCalendarWidget*>("calendarWidget");
-    QListWidget *appointmentsList = window->findChild<QListWidget*>("appointmentsList");
-    
-    // --- Load Appointments for seleceted datee ---
+    // --- Load Appointments for selected date ---
     if (calendar && appointmentsList) {
-        QObject::connect(calendar, &QCalendarWidget::selectionChanged, [=, &db]() {
-            appointmentsList->clear();
-            QDate selectedDate = calendar->selectedDate();
-            QString dateStr = selectedDate.toString("yyyy-MM-dd");
-
-            QSqlQuery query(db);
-            query.prepare("SELECT a.time, a.patientId, p.name, a.purpose "
-                        "FROM Appointments a "
-                        "JOIN Patients p ON a.patientId = p.id "
-                        "WHERE a.date = ?");
-            query.addBindValue(dateStr);
-            if (!query.exec()) {
-                writeLog("Failed to fetch appointments: " + query.lastError().text());
+        QObject::connect(calendar, &QCalendarWidget::selectionChanged, [&]() {
+            showAppointments(calendar->selectedDate());
+        });
+        QObject::connect(calendar, &QCalendarWidget::currentPageChanged, [&](int year, int month) {
+            appointmentCache.loadPage(year, month);
+        });
+        QObject::connect(appointmentsList, &QListWidget::currentItemChanged, [&](QListWidgetItem *item) {
+            const DayAppointment *a = item ? appointmentCache.find(item->data(Qt::UserRole).toInt()) : nullptr;
+            if (!a) return;
+            appointmentPatientId->setText(QString::number(a->patientId));
+            appointmentDateEdit->setDate(QDate::fromString(a->date, "yyyy-MM-dd"));
+            appointmentTimeEdit->setTime(QTime::fromString(a->time, "HH:mm"));
+            appointmentPurposeTextEdit->setPlainText(a->purpose);
+            appointmentCompletedCheckBox->setChecked(a->completed);
+            if (appointmentDurationSpinBox) appointmentDurationSpinBox->setValue(a->durationMinutes);
+        });
+    }
+
+    // --- Lazy tabs ---
+    // The Appointments and Treatments tabs load their data the first time
+    // they are shown instead of during startup.
+    QWidget *appointmentsTab = window->findChild<QWidget*>("appointmentsTab");
+    bool appointmentsLoaded = false;
+    auto showTab = [&](int index) {
+        QWidget *tab = tabWidget->widget(index);
+        if (tab == appointmentsTab && !appointmentsLoaded) {
+            appointmentsLoaded = true;
+            refreshAppointments();
+        } else if (tab == treatmentsTab && formPatientId > 0 && formPatientId != treatmentsPatientId) {
+            refreshTreatments(formPatientId);
+        }
+    };
+    if (tabWidget) {
+        QObject::connect(tabWidget, &QTabWidget::currentChanged, showTab);
+        showTab(tabWidget->currentIndex());
+    } else {
+        refreshAppointments();
+    }
+
+    // --- Import Data ---
+    QStatusBar *statusBar = window->findChild<QStatusBar*>("statusbar");
+    QAction *importAction = window->findChild<QAction*>("actionImport_Data");
+    if (importAction && statusBar) {
+        QObject::connect(importAction, &QAction::triggered, [&]() {
+            QString path = QFileDialog::getOpenFileName(window, "Import Data", QString(),
+                                                        "Data files (*.csv *.jsonl *.ndjson)");
+            if (path.isEmpty()) return;
+
+            QStringList tables{"Patients", "Appointments", "Treatments"};
+            int guess = 0;
+            for (int i = 0; i < tables.size(); ++i)
+                if (QFileInfo(path).baseName().contains(tables[i], Qt::CaseInsensitive)) guess = i;
+            bool ok = false;
+            QString tableName = QInputDialog::getItem(window, "Import Data", "Import into table:", tables, guess, false, &ok);
+            ClinicTable table;
+            if (!ok || !parseClinicTable(tableName, &table)) return;
+
+            importAction->setEnabled(false);
+            statusBar->showMessage("Importing " + QFileInfo(path).fileName() + "...");
+            jobs->start("clinic_import", [jobs, window, statusBar, importAction, path, table](QSqlDatabase &jdb) {
+                ImportResult r = importFile(jdb, table, path, [statusBar](const ImportProgress &p) {
+                    QString msg = QString("Importing: %1 rows, %2 rejected (%3%)")
+                                  .arg(p.rowsImported).arg(p.rowsRejected)
+                                  .arg(p.totalBytes > 0 ? p.bytesRead * 100 / p.totalBytes : 100);
+                    QMetaObject::invokeMethod(statusBar, [statusBar, msg]() { statusBar->showMessage(msg); },
+                                              Qt::QueuedConnection);
+                }, &jobs->importCancelled);
+                QMetaObject::invokeMethod(jobs, [window, statusBar, importAction, r]() {
+                    importAction->setEnabled(true);
+                    statusBar->showMessage(QString("Import %1: %2 rows imported, %3 rejected")
+                                           .arg(r.ok ? "finished" : "stopped")
+                                           .arg(r.rowsImported).arg(r.rowsRejected), 10000);
+                    if (!r.ok && !r.error.isEmpty())
+                        QMessageBox::warning(window, "Import Data", r.error + "\nRun the import again to resume.");
+                }, Qt::QueuedConnection);
+            });
+        });
+    }
+
+    // --- Export Data ---
+    QAction *exportAction = window->findChild<QAction*>("actionExport_Data");
+    if (exportAction && statusBar) {
+        QPushButton *cancelExportBtn = new QPushButton("Cancel export", statusBar);
+        statusBar->addPermanentWidget(cancelExportBtn);
+        cancelExportBtn->hide();
+        QObject::connect(cancelExportBtn, &QPushButton::clicked, [jobs]() { jobs->exportCancelled = true; });
+
+        QObject::connect(exportAction, &QAction::triggered, [&, cancelExportBtn]() {
+            QString dir = QFileDialog::getExistingDirectory(window, "Export Data");
+            if (dir.isEmpty()) return;
+
+            bool ok = false;
+            QString formatName = QInputDialog::getItem(window, "Export Data", "Format:",
+                                                       QStringList{"CSV", "JSON Lines"}, 0, false, &ok);
+            if (!ok) return;
+            ExportFormat format = formatName == "CSV" ? ExportFormat::Csv : ExportFormat::JsonLines;
+            QString extension = format == ExportFormat::Csv ? ".csv" : ".jsonl";
+
+            exportAction->setEnabled(false);
+            jobs->exportCancelled = false;
+            cancelExportBtn->show();
+            jobs->start("clinic_export", [jobs, statusBar, exportAction, dir, format, extension, cancelExportBtn](QSqlDatabase &jdb) {
+                // One read transaction, so the three files show the same moment.
+                QString summary;
+                bool inTransaction = jdb.transaction();
+                if (!inTransaction) {
+                    summary = "Export failed: could not start a read transaction: " + jdb.lastError().text();
+                    writeLog(summary, LogLevel::Error);
+                }
+                for (ClinicTable table : {ClinicTable::Patients, ClinicTable::Appointments, ClinicTable::Treatments}) {
+                    if (!inTransaction) break;
+                    QString name = tableName(table);
+                    QString path = QDir(dir).filePath(name.toLower() + extension);
+                    ExportResult r = exportTable(jdb, table, format, path, [statusBar, name](qint64 rows, qint64 total) {
+                        QString msg = QString("Exporting %1: %2 / %3 rows").arg(name).arg(rows).arg(total);
+                        QMetaObject::invokeMethod(statusBar, [statusBar, msg]() { statusBar->showMessage(msg); },
+                                                  Qt::QueuedConnection);
+                    }, &jobs->exportCancelled);
+
+                    if (r.cancelled) {
+                        summary = "Export cancelled";
+                        break;
+                    }
+                    if (!r.ok) {
+                        summary = "Export failed: " + r.error;
+                        writeLog(summary, LogLevel::Error);
+                        break;
+                    }
+                    summary += QString("%1%2 %3").arg(summary.isEmpty() ? QString("Exported ") : QString(", ")).arg(r.rows).arg(name);
+                }
+                if (inTransaction) jdb.commit();
+                QMetaObject::invokeMethod(jobs, [statusBar, exportAction, summary, cancelExportBtn]() {
+                    cancelExportBtn->hide();
+                    exportAction->setEnabled(true);
+                    statusBar->showMessage(summary, 10000);
+                }, Qt::QueuedConnection);
+            });
+        });
+    }
+
+    // --- Reports ---
+    // The snapshot is loaded on a background connection the first time the
+    // Reports tab is shown. Later runs pass it the change events received
+    // since, so only new and edited rows are read; the report is computed on
+    // the same thread. One run is in flight at a time.
+    QWidget *reportsTab = window->findChild<QWidget*>("reportsTab");
+    QDateEdit *reportFromEdit = window->findChild<QDateEdit*>("reportFromEdit");
+    QDateEdit *reportToEdit = window->findChild<QDateEdit*>("reportToEdit");
+    QComboBox *reportKindCombo = window->findChild<QComboBox*>("reportKindCombo");
+    QComboBox *reportGroupCombo = window->findChild<QComboBox*>("reportGroupCombo");
+    QPushButton *exportReportBtn = window->findChild<QPushButton*>("exportReportBtn");
+    QTableWidget *reportTableWidget = window->findChild<QTableWidget*>("reportTable");
+    QLabel *reportSummaryLabel = window->findChild<QLabel*>("reportSummaryLabel");
+
+    bool reportsLoaded = false;
+    QTimer reportTimer;
+    std::function<void()> updateReport;
+
+    if (reportsTab && reportFromEdit && reportToEdit && reportKindCombo && reportGroupCombo && reportTableWidget) {
+        reportFromEdit->setDate(QDate::currentDate().addDays(-27));
+        reportToEdit->setDate(QDate::currentDate());
+
+        auto currentReportTable = [&]() {
+            return reportTable(jobs->currentReport, ReportKind(reportKindCombo->currentIndex()),
+                               reportGroupCombo->currentIndex() == 1);
+        };
+        auto showReport = [&]() {
+            ReportTable table = currentReportTable();
+            reportTableWidget->clear();
+            reportTableWidget->setColumnCount(table.header.size());
+            reportTableWidget->setHorizontalHeaderLabels(table.header);
+            reportTableWidget->setRowCount(int(table.rows.size()));
+            for (int r = 0; r < int(table.rows.size()); ++r)
+                for (int c = 0; c < table.rows[r].size(); ++c)
+                    reportTableWidget->setItem(r, c, new QTableWidgetItem(table.rows[r][c]));
+            reportTableWidget->resizeColumnsToContents();
+            reportGroupCombo->setEnabled(reportKindCombo->currentIndex() == int(ReportKind::Visits));
+
+            int visits = jobs->currentReport.total(jobs->currentReport.visits);
+            const std::array<int, 4> &byVisits = jobs->currentReport.patientsByVisits;
+            int patients = byVisits[0] + byVisits[1] + byVisits[2] + byVisits[3];
+            if (reportSummaryLabel)
+                reportSummaryLabel->setText(QString("%1 visits, %2% completed, %3 patients (%4 returning)\n%5")
+                                            .arg(visits).arg(percentText(jobs->currentReport.total(jobs->currentReport.completed), visits))
+                                            .arg(patients).arg(patients - byVisits[0]).arg(jobs->reportStats));
+        };
+
+        updateReport = [&, showReport]() {
+            if (jobs->reportRunning) {
+                jobs->reportRerun = true;
                 return;
             }
+            jobs->reportRunning = true;
+            bool reload = !jobs->reportSnapshot || jobs->reportReloadPending;
+            jobs->reportReloadPending = false;
+            if (!jobs->reportSnapshot) jobs->reportSnapshot = std::make_shared<ReportSnapshot>();
+            std::shared_ptr<ReportSnapshot> snapshot = jobs->reportSnapshot;
+            std::vector<RowChange> changes;
+            changes.swap(jobs->reportChanges);
+            QDate from = reportFromEdit->date();
+            QDate to = reportToEdit->date();
+
+            jobs->start("clinic_reports", [jobs, &updateReport, showReport, snapshot, changes, reload, from, to](QSqlDatabase &rdb) {
+                QElapsedTimer timer;
+                timer.start();
+                bool ok = reload ? snapshot->load(rdb) : snapshot->refresh(rdb, changes);
+                qint64 loadMs = timer.elapsed();
+                ClinicReport report = computeReport(*snapshot, from, to);
+                QString stats = QString("Snapshot: %1 appointments, %2 MiB, %3 in %4 ms; report in %5 ms on %6 threads")
+                                .arg(snapshot->appointmentCount())
+                                .arg(snapshot->memoryBytes() / (1024.0 * 1024.0), 0, 'f', 1)
+                                .arg(reload ? "loaded" : "refreshed").arg(loadMs)
+                                .arg(report.computeUs / 1000.0, 0, 'f', 1).arg(report.threads);
+                writeLog(stats, LogLevel::Debug);
+                QMetaObject::invokeMethod(jobs, [jobs, &updateReport, showReport, ok, report, stats]() {
+                    jobs->reportRunning = false;
+                    if (!ok) jobs->reportReloadPending = true;
+                    jobs->currentReport = report;
+                    jobs->reportStats = stats;
+                    showReport();
+                    if (jobs->reportRerun) {
+                        jobs->reportRerun = false;
+                        updateReport();
+                    }
+                }, Qt::QueuedConnection);
+            });
+        };
+
+        reportTimer.setSingleShot(true);
+        reportTimer.setInterval(500);
+        QObject::connect(&reportTimer, &QTimer::timeout, [&]() { updateReport(); });
+        QObject::connect(reportFromEdit, &QDateEdit::dateChanged, [&]() { reportTimer.start(); });
+        QObject::connect(reportToEdit, &QDateEdit::dateChanged, [&]() { reportTimer.start(); });
+        QObject::connect(reportKindCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), showReport);
+        QObject::connect(reportGroupCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), showReport);
+
+        ChangeBus::instance().subscribe(window, [&](const std::vector<RowChange> &changes) {
+            if (!reportsLoaded) return;
+            for (const RowChange &c : changes) {
+                if (c.table != ClinicTable::Appointments && c.table != ClinicTable::Treatments) continue;
+                // A bulk insert may hold ids below the snapshot's last one, which
+                // an incremental refresh does not read.
+                if (c.op == ChangeOp::BulkInsert) jobs->reportReloadPending = true;
+                else jobs->reportChanges.push_back(c);
+            }
+            // Past this many single-row events a full load is cheaper.
+            if (jobs->reportChanges.size() > 5000) {
+                jobs->reportChanges.clear();
+                jobs->reportReloadPending = true;
+            }
+            if (tabWidget && tabWidget->currentWidget() == reportsTab) reportTimer.start();
+        });
+        if (tabWidget) {
+            QObject::connect(tabWidget, &QTabWidget::currentChanged, [&](int index) {
+                if (tabWidget->widget(index) != reportsTab) return;
+                reportsLoaded = true;
+                updateReport();
+            });
+        }
 
-            while (query.next()) {
-                QString time = query.value(0).toString();
-                int patientId = query.value(1).toInt();
-                QString patientName = query.value(2).toString();
-                QString purpose = query.value(3).toString();
-
-                QString line = QString("%1 Patient (%2) %3 %4")
-                                .arg(time)
-                                .arg(patientId)
-                                .arg(patientName)
-                                .arg(purpose);
+        if (exportReportBtn) {
+            QObject::connect(exportReportBtn, &QPushButton::clicked, [&, currentReportTable]() {
+                QString name = reportKindCombo->currentText().toLower().replace(' ', '-');
+                QString path = QFileDialog::getSaveFileName(window, "Export Report", name + ".csv", "CSV files (*.csv)");
+                if (path.isEmpty()) return;
+                QFile file(path);
+                if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                    QMessageBox::warning(window, "Export Report", "Cannot write " + path + ": " + file.errorString());
+                    return;
+                }
+                writeReportCsv(currentReportTable(), &file);
+                if (statusBar) statusBar->showMessage("Report written to " + path, 10000);
+            });
+        }
+    }
 
-                appointmentsList->addItem(line);
+    // --- Backup ---
+    // Snapshots run on their own background connection. The schedule is
+    // checked every ten minutes against the newest snapshot's age, so a missed
+    // run (the app was closed) is made up shortly after the next start.
+    QAction *backupAction = window->findChild<QAction*>("actionBackup_Now");
+    QAction *restoreAction = window->findChild<QAction*>("actionRestore_Backup");
+    auto startBackup = [&]() {
+        if (jobs->backupRunning) return;
+        jobs->backupRunning = true;
+        if (backupAction) backupAction->setEnabled(false);
+        if (statusBar) statusBar->showMessage("Backing up clinic.db...");
+        BackupSettings settings = loadBackupSettings();
+        jobs->start("clinic_backup", [jobs, window, statusBar, backupAction, settings](QSqlDatabase &bdb) {
+            BackupReport r = backupDatabase(bdb, settings);
+            QMetaObject::invokeMethod(jobs, [jobs, window, statusBar, backupAction, r]() {
+                jobs->backupRunning = false;
+                if (backupAction) backupAction->setEnabled(true);
+                if (statusBar) statusBar->showMessage(r.summary(), 15000);
+                if (!r.ok) QMessageBox::warning(window, "Backup", r.summary());
+            }, Qt::QueuedConnection);
+        });
+    };
+    if (backupAction) QObject::connect(backupAction, &QAction::triggered, startBackup);
+
+    QTimer backupTimer;
+    auto backupIfDue = [&]() {
+        BackupSettings settings = loadBackupSettings();
+        if (settings.intervalHours <= 0) return;
+        QStringList snapshots = listBackups(settings.directory);
+        QDateTime newest = snapshots.isEmpty() ? QDateTime() : QFileInfo(snapshots.first()).lastModified();
+        if (!newest.isValid() || newest.secsTo(QDateTime::currentDateTime()) >= settings.intervalHours * 3600LL)
+            startBackup();
+    };
+    backupTimer.setInterval(10 * 60 * 1000);
+    QObject::connect(&backupTimer, &QTimer::timeout, backupIfDue);
+    backupTimer.start();
+    QTimer::singleShot(60 * 1000, window, backupIfDue);
+
+    // After a restore every view reloads: the change events only describe
+    // writes made through the repositories.
+    auto reloadAllViews = [&]() {
+        historyCache.clear();
+        refreshPatients();
+        if (appointmentsLoaded) refreshAppointments();
+        if (treatmentsPatientId > 0) refreshTreatments(treatmentsPatientId);
+        if (jobs->lookupBuilding) jobs->lookupRebuildPending = true;
+        else buildLookupIndex();
+        jobs->reportChanges.clear();
+        jobs->reportReloadPending = true;
+        if (reportsLoaded) updateReport();
+    };
+    if (restoreAction) {
+        QObject::connect(restoreAction, &QAction::triggered, [&]() {
+            QStringList snapshots = listBackups(loadBackupSettings().directory,
+                                                QStringList{kBackupPattern, kPreRestorePattern});
+            if (snapshots.isEmpty()) {
+                QMessageBox::information(window, "Restore Backup", "No backups found.");
+                return;
             }
-            refreshAppointments();
+            QStringList names;
+            for (const QString &path : snapshots) names << QFileInfo(path).fileName();
+            bool ok = false;
+            QString name = QInputDialog::getItem(window, "Restore Backup", "Restore clinic data from:", names, 0, false, &ok);
+            if (!ok) return;
+            QString path = snapshots[names.indexOf(name)];
+            if (QMessageBox::question(window, "Restore Backup",
+                                      "Replace all current data with " + name + "?\n"
+                                      "The current data is backed up first.") != QMessageBox::Yes) return;
+
+            restoreAction->setEnabled(false);
+            if (statusBar) statusBar->showMessage("Restoring " + name + "...");
+            jobs->start("clinic_restore", [jobs, window, statusBar, restoreAction, &reloadAllViews, path](QSqlDatabase &rdb) {
+                BackupReport r = restoreDatabase(rdb, path);
+                QMetaObject::invokeMethod(jobs, [window, statusBar, restoreAction, &reloadAllViews, r]() {
+                    restoreAction->setEnabled(true);
+                    if (statusBar) statusBar->showMessage(r.ok ? "Restored " + QFileInfo(r.path).fileName()
+                                                               : "Restore failed: " + r.error, 15000);
+                    if (r.ok) reloadAllViews();
+                    else QMessageBox::warning(window, "Restore Backup", "Restore failed: " + r.error);
+                }, Qt::QueuedConnection);
+            });
+        });
+    }
+
+    // --- Diagnostics ---
+    QTimer metricsTimer;
+    if (statusBar) {
+        QLabel *metricsLabel = new QLabel(statusBar);
+        statusBar->addPermanentWidget(metricsLabel);
+        metricsTimer.setInterval(1000);
+        QObject::connect(&metricsTimer, &QTimer::timeout, [&, metricsLabel]() {
+            metricsLabel->setText(QueryMetrics::instance().summary() + " | " + historyCache.summary());
+        });
+        metricsTimer.start();
+    }
+    QAction *diagnosticsAction = window->findChild<QAction*>("actionDiagnostics");
+    if (diagnosticsAction) {
+        QObject::connect(diagnosticsAction, &QAction::triggered, [&]() { showDiagnostics(window); });
+    }
+
+    // --- Settings ---
+    QAction *settingsAction = window->findChild<QAction*>("actionSettings");
+    if (settingsAction) {
+        QObject::connect(settingsAction, &QAction::triggered, [&]() {
+            SqliteProfile profile = loadSqliteProfile();
+            if (!editSqliteProfile(window, &profile)) return;
+            saveSqliteProfile(profile);
+            QString error;
+            if (!applySqliteProfile(db, profile, &error))
+                QMessageBox::warning(window, "Settings", "Some settings could not be applied:\n" + error);
+            worker.run([profile](QSqlDatabase &wdb) {
+                QString workerError;
+                applySqliteProfile(wdb, profile, &workerError);
+                return workerError;
+            }, window, [window](QString workerError) {
+                if (!workerError.isEmpty())
+                    QMessageBox::warning(window, "Settings",
+                                         "Some settings could not be applied to the background connection:\n" + workerError);
+            });
+            writeLog(QString("SQLite profile: journal_mode=%1 synchronous=%2 cache=%3KiB mmap=%4 temp_store=%5 busy_timeout=%6ms")
+                     .arg(profile.journalMode, profile.synchronous).arg(profile.cacheSizeKiB)
+                     .arg(profile.mmapSizeBytes).arg(profile.tempStore).arg(profile.busyTimeoutMs));
         });
     }
 
@@ -481,19 +1885,11 @@ int main(int argc, char *argv[]) {
                 return;
             }
 
-            std::vector<std::string> meds;
-            for (const QString &m : medsStr.split(';', Qt::SkipEmptyParts)) {
-                meds.push_back(m.trimmed().toStdString());
-            }
+            std::vector<std::string> meds = splitMedications(medsStr.toStdString());
 
             Treatment t{0, patientId, appointmentId, notes.toStdString(), meds};
-            addTreatment(db, t);
-
-            // Refresh treatments list
-            auto treatments = getTreatmentsByPatient(db, patientId);
-            treatmentsList->clear();
-            for (const auto &tr : treatments)
-                treatmentsList->addItem(QString::fromStdString(tr.notes));
+            if (patientId != treatmentsPatientId) refreshTreatments(patientId);
+            worker.run([t](QSqlDatabase &wdb) { return addTreatment(wdb, t); }, window, reportWriteFailure("add the treatment"));
         });
     }
 
@@ -505,21 +1901,12 @@ int main(int argc, char *argv[]) {
         QString notes = treatmentNotesTextEdit->toPlainText().trimmed();
         QString medsStr = treatmentMedicationsTextEdit->toPlainText().trimmed();
 
-        std::vector<std::string> meds;
-        for (const QString &m : medsStr.split(';', Qt::SkipEmptyParts)) {
-            meds.push_back(m.trimmed().toStdString());
-        }
+        std::vector<std::string> meds = splitMedications(medsStr.toStdString());
 
-        QSqlQuery query(db);
-        query.prepare("UPDATE Treatments SET patientId=?, appointmentId=?, notes=?, medications=? WHERE patientId=? AND appointmentId=?");
-        query.addBindValue(patientId);
-        query.addBindValue(appointmentId);
-        query.addBindValue(notes);
-        query.addBindValue(medsStr);
-        query.addBindValue(patientId);
-        query.addBindValue(appointmentId);
-
-        if (!query.exec()) writeLog("Failed to edit treatment: " + query.lastError().text());
+        Treatment t{0, patientId, appointmentId, notes.toStdString(), meds};
+        if (patientId != treatmentsPatientId) refreshTreatments(patientId);
+        worker.run([t](QSqlDatabase &wdb) { return updateTreatment(wdb, t); }, window,
+                   reportWriteFailure("update the treatment"));
     });
 
     // --- Delete Treatment ---
@@ -528,15 +1915,31 @@ int main(int argc, char *argv[]) {
         int patientId = treatmentPatientId->text().toInt();
         int appointmentId = treatmentAppointmentId->text().toInt();
 
-        QSqlQuery query(db);
-        query.prepare("DELETE FROM Treatments WHERE patientId=? AND appointmentId=?");
-        query.addBindValue(patientId);
-        query.addBindValue(appointmentId);
-
-        if (!query.exec()) writeLog("Failed to delete treatment: " + query.lastError().text());
+        if (patientId != treatmentsPatientId) refreshTreatments(patientId);
+        worker.run([patientId, appointmentId](QSqlDatabase &wdb) {
+            return deleteTreatment(wdb, patientId, appointmentId);
+        }, window, reportWriteFailure("delete the treatment"));
     });
 
 
 
-    return app.exec();
+    startup.mark("wire up window");
+    QTimer::singleShot(0, window, [&]() {
+        startup.mark("first event loop turn");
+        writeLog("Startup phases:\n" + startup.report().trimmed(), LogLevel::Debug);
+        if (app.arguments().contains("--startup-timings")) QTextStream(stdout) << startup.report() << Qt::flush;
+    });
+
+    int rc = app.exec();
+    jobs->stop();
+    worker.stop();
+    releaseRepositories(db);
+    writeLog("Query metrics: " + QueryMetrics::instance().summary());
+    writeLog("Treatment " + historyCache.summary());
+    dumpMetricsIfRequested(app.arguments());
+    writeLog(QString("Statement cache: %1 hits, %2 misses")
+             .arg(statementCacheStats().hits.load())
+             .arg(statementCacheStats().misses.load()));
+    Logger::instance().shutdown();
+    return rc;
 }